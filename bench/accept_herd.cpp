@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Wakeups per connection for N workers waiting on one shared listener:
+ *
+ *   accept_herd [workers [connections]]
+ *
+ * Every worker counts the times epoll_wait came back with the listener,
+ * the times accept() found nothing left and its own voluntary context
+ * switches (getrusage), which also catches the wakeups which went back to
+ * sleep inside the kernel. The report is printed as JSON, one object per
+ * mode (plain epoll, EPOLLEXCLUSIVE, accept_mutex).
+ *
+ * In accept_mutex mode the workers also sleep on their own, without the
+ * listener: the losers back off before retrying the lock and the holder's
+ * epoll_wait times out to hand it on. Those sleeps are counted apart as
+ * polling_switches and left out of context_switches.
+ */
+
+#include <remote/accept.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <new>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+	enum class mode { plain, exclusive, mutex };
+
+	const char* name(mode m)
+	{
+		switch (m)
+		{
+		case mode::plain: return "epoll";
+		case mode::exclusive: return "epoll_exclusive";
+		case mode::mutex: return "accept_mutex";
+		}
+		return "?";
+	}
+
+	struct counters
+	{
+		std::atomic<bool> stop;
+		std::atomic<unsigned long> wakeups;
+		std::atomic<unsigned long> empty;
+		std::atomic<unsigned long> accepted;
+		std::atomic<unsigned long> switches;
+		std::atomic<unsigned long> polls;
+	};
+
+	long context_switches()
+	{
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_nvcsw;
+	}
+
+	int listener(sockaddr_in& addr)
+	{
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = 0;
+
+		socklen_t len = sizeof(addr);
+		if (bind(fd, (sockaddr*)&addr, len) || listen(fd, 1024) || getsockname(fd, (sockaddr*)&addr, &len))
+		{
+			perror("listener");
+			exit(1);
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		return fd;
+	}
+
+	void drain(int fd, counters* shared)
+	{
+		bool got = false;
+		for (;;)
+		{
+			int conn = accept(fd, nullptr, nullptr);
+			if (conn < 0)
+				break;
+			++shared->accepted;
+			close(conn);
+			got = true;
+		}
+
+		if (!got)
+			++shared->empty;
+	}
+
+	void worker(mode m, int fd, int stop, counters* shared, remote::accept_mutex& mtx)
+	{
+		auto start = context_switches();
+
+		int ep = epoll_create1(0);
+		bool registered = false;
+
+		epoll_event stop_ev{};
+		stop_ev.events = EPOLLIN;
+		stop_ev.data.fd = stop;
+		epoll_ctl(ep, EPOLL_CTL_ADD, stop, &stop_ev);
+
+		if (m == mode::exclusive)
+			registered = remote::watch_exclusive(ep, fd);
+
+		if (!registered && m != mode::mutex)
+		{
+			epoll_event ev{};
+			ev.events = EPOLLIN;
+			ev.data.fd = fd;
+			epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+			registered = true;
+		}
+
+		while (!shared->stop)
+		{
+			if (m == mode::mutex)
+			{
+				// like nginx: only the lock holder keeps the listener in its set
+				if (!mtx.try_lock())
+				{
+					++shared->polls;
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+
+				epoll_event ev{};
+				ev.events = EPOLLIN;
+				ev.data.fd = fd;
+				epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+
+				epoll_event out;
+				int ret = epoll_wait(ep, &out, 1, 10);
+				epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+				if (ret > 0 && out.data.fd == fd)
+				{
+					++shared->wakeups;
+					drain(fd, shared);
+				}
+				else if (!ret)
+					++shared->polls;
+				mtx.unlock();
+				continue;
+			}
+
+			epoll_event out;
+			if (epoll_wait(ep, &out, 1, -1) > 0 && out.data.fd == fd)
+			{
+				++shared->wakeups;
+				drain(fd, shared);
+			}
+		}
+
+		close(ep);
+		shared->switches += context_switches() - start;
+	}
+
+	void run(mode m, int workers, int connections)
+	{
+		sockaddr_in addr;
+		int fd = listener(addr);
+
+		auto shared = (counters*)mmap(nullptr, sizeof(counters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		new (shared) counters{};
+
+		remote::accept_mutex mtx;
+		if (m == mode::mutex && !mtx)
+		{
+			fprintf(stderr, "accept_mutex could not be created\n");
+			exit(1);
+		}
+
+		int stop[2];
+		if (pipe(stop))
+		{
+			perror("pipe");
+			exit(1);
+		}
+
+		std::vector<pid_t> children;
+		for (int i = 0; i < workers; ++i)
+		{
+			pid_t pid = fork();
+			if (!pid)
+			{
+				worker(m, fd, stop[0], shared, mtx);
+				_exit(0);
+			}
+			children.push_back(pid);
+		}
+
+		// let everybody settle in epoll_wait
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < connections; ++i)
+		{
+			int conn = socket(AF_INET, SOCK_STREAM, 0);
+			connect(conn, (sockaddr*)&addr, sizeof(addr));
+			close(conn);
+
+			// one connection at a time, so every wakeup is attributable
+			while (shared->accepted.load() < (unsigned long)i + 1)
+				std::this_thread::yield();
+		}
+		auto elapsed = std::chrono::steady_clock::now() - start;
+
+		shared->stop = true;
+		(void)!write(stop[1], "", 1);
+		for (auto pid : children)
+			waitpid(pid, nullptr, 0);
+
+		auto wakeups = shared->wakeups.load();
+		auto accepted = shared->accepted.load();
+		// the stop pipe wakes everybody once more
+		auto total = shared->switches.load() - workers;
+		auto polls = shared->polls.load();
+		auto switches = total > polls ? total - polls : 0;
+		auto per = [=](unsigned long value) { return accepted ? (double)value / accepted : 0.0; };
+		printf("{\"mode\":\"%s\",\"workers\":%d,\"connections\":%d,\"accepted\":%lu,"
+			"\"wakeups\":%lu,\"empty_wakeups\":%lu,\"context_switches\":%lu,\"polling_switches\":%lu,"
+			"\"wakeups_per_connection\":%.3f,\"switches_per_connection\":%.3f,\"us_per_connection\":%.3f}\n",
+			name(m), workers, connections, accepted,
+			wakeups, shared->empty.load(), switches, polls,
+			per(wakeups), per(switches),
+			std::chrono::duration<double, std::micro>(elapsed).count() / (connections ? connections : 1));
+
+		munmap(shared, sizeof(counters));
+		close(stop[0]);
+		close(stop[1]);
+		close(fd);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int workers = argc > 1 ? atoi(argv[1]) : 16;
+	int connections = argc > 2 ? atoi(argv[2]) : 1000;
+
+	for (auto m : { mode::plain, mode::exclusive, mode::mutex })
+		run(m, workers, connections);
+}
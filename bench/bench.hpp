@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_BENCH_HPP__
+#define __LIBREMOTE_BENCH_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * The pieces shared by the benchmarks of libremote_bench. A benchmark is a
+ * function registered with BENCH(); it measures whatever it wants to and
+ * hands samples (nanoseconds per operation) to bench::context::report,
+ * which adds a JSON object to the output. The iteration counts are fixed,
+ * so two runs on the same machine measure the same work.
+ */
+namespace bench
+{
+	using clock = std::chrono::steady_clock;
+
+	inline int64_t elapsed_ns(clock::time_point from, clock::time_point to = clock::now())
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+	}
+
+	// extra numbers for a result, e.g. { "rss_mb", 256 }
+	using params = std::vector<std::pair<const char*, double>>;
+
+	class context
+	{
+		std::string m_filter;
+	public:
+		unsigned scale = 1; // --quick divides the iteration counts by 10
+
+		explicit context(const std::string& filter) : m_filter(filter) {}
+
+		// false, if a result of that name was filtered out on the command line
+		bool wanted(const std::string& name) const;
+
+		// summarizes the samples (min, mean, p50, p90, p99, p99.9, max) and
+		// prints them; ops_per_sec, when not 0, is reported next to them
+		void report(const std::string& name, std::vector<double> samples, double ops_per_sec = 0, const params& extra = {});
+
+		// a result without samples: throughput or a count
+		void report(const std::string& name, const params& values);
+
+		size_t iterations(size_t count) const { return count / scale ? count / scale : 1; }
+	};
+
+	struct registrar
+	{
+		using function = void (*)(context&);
+		registrar(const char* name, function fn);
+	};
+
+	std::vector<std::pair<const char*, registrar::function>>& registry();
+
+	// a file name in a directory of its own, removed at exit
+	std::string temp_path(const char* name);
+}
+
+#define BENCH(name) \
+	static void bench_##name(bench::context& ctx); \
+	static bench::registrar bench_registrar_##name{ #name, bench_##name }; \
+	static void bench_##name(bench::context& ctx)
+
+#endif // __LIBREMOTE_BENCH_HPP__
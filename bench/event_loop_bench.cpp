@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The supervisor's event loop, io_uring against epoll, under one driver:
+ * a pool of N forked workers exits at once, while N/10 output pipes have a
+ * line to be read and N lines go to the log. The loop is timed from the
+ * moment all of that is under way until the last of it is done; the
+ * system calls it made are reported per item, next to the time. An idle
+ * tick with the whole pool watched is measured on its own.
+ */
+
+#include "bench.hpp"
+#include <remote/event_loop.hpp>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+	int64_t cpu_ns()
+	{
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ll +
+			(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ll;
+	}
+
+	// the workers wait for the end of the pipe, so they all go at once
+	bool start_pool(size_t count, std::vector<int>& pids, int& go)
+	{
+		int fds[2];
+		if (pipe2(fds, O_CLOEXEC))
+			return false;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			int pid = fork();
+			if (pid < 0)
+				break;
+			if (!pid)
+			{
+				char c;
+				::close(fds[1]);
+				while (read(fds[0], &c, 1) < 0 && errno == EINTR)
+					;
+				_exit(0);
+			}
+			pids.push_back(pid);
+		}
+		::close(fds[0]);
+		go = fds[1];
+		return pids.size() == count;
+	}
+
+	void stop_pool(std::vector<int>& pids, int go)
+	{
+		if (go >= 0)
+			::close(go);
+		for (auto pid : pids)
+			waitpid(pid, nullptr, 0);
+		pids.clear();
+	}
+
+	void run(bench::context& ctx, remote::event_loop::kind kind, size_t workers, const std::string& log)
+	{
+		auto probe = remote::event_loop::create(kind);
+		if (!probe)
+		{
+			fprintf(stderr, "event_loop: no %s here\n", kind == remote::event_loop::kind::io_uring ? "io_uring" : "epoll");
+			return;
+		}
+		std::string prefix = std::string{ "event_loop." } + probe->name() + '.' + std::to_string(workers);
+		probe.reset();
+
+		auto name = prefix + ".burst";
+		if (ctx.wanted(name))
+		{
+			size_t pipes = workers / 10 ? workers / 10 : 1;
+			size_t items = workers + pipes + workers;
+			std::vector<double> samples;
+			double syscalls = 0, cpu = 0;
+
+			for (size_t round = 0; round < ctx.iterations(10); ++round)
+			{
+				auto loop = remote::event_loop::create(kind);
+				std::vector<int> pids;
+				int go = -1;
+				if (!start_pool(workers, pids, go))
+				{
+					fprintf(stderr, "%s: fork failed after %zu workers\n", name.c_str(), pids.size());
+					stop_pool(pids, go);
+					return;
+				}
+
+				size_t exited = 0;
+				for (auto pid : pids)
+				{
+					if (!loop->watch_child(pid, [&](int, int) { ++exited; }))
+						fprintf(stderr, "%s: cannot watch %d\n", name.c_str(), pid);
+				}
+
+				std::vector<int> ends;
+				size_t read = 0;
+				for (size_t i = 0; i < pipes; ++i)
+				{
+					int fds[2];
+					if (pipe2(fds, O_CLOEXEC | O_NONBLOCK))
+						break;
+					ends.push_back(fds[0]);
+					ends.push_back(fds[1]);
+					loop->watch_read(fds[0], 4096, [&](const char*, size_t size) { read += size; });
+				}
+				pipes = ends.size() / 2;
+				items = workers + pipes + workers;
+
+				int file = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+				auto before = loop->stats().syscalls;
+				auto cpu_before = cpu_ns();
+				auto start = bench::clock::now();
+
+				::close(go);
+				go = -1;
+				for (size_t i = 0; i < pipes; ++i)
+					while (::write(ends[i * 2 + 1], "worker output\n", 14) < 0 && errno == EINTR)
+						;
+				for (size_t i = 0; i < workers; ++i)
+					loop->write(file, "[pool:" + std::to_string(i) + "] worker exited with status 0\n");
+
+				auto deadline = start + std::chrono::seconds{ 30 };
+				while ((exited < workers || read < pipes * 14 || loop->writing()) && bench::clock::now() < deadline)
+					loop->run_once(std::chrono::milliseconds{ 100 });
+
+				samples.push_back((double)bench::elapsed_ns(start) / items);
+				cpu += (double)(cpu_ns() - cpu_before) / items;
+				syscalls += (double)(loop->stats().syscalls - before) / items;
+
+				if (exited < workers)
+					fprintf(stderr, "%s: %zu of %zu exits seen\n", name.c_str(), exited, workers);
+
+				loop.reset();
+				::close(file);
+				for (auto fd : ends)
+					::close(fd);
+				stop_pool(pids, go);
+			}
+
+			if (!samples.empty())
+			{
+				double n = (double)samples.size();
+				ctx.report(name, std::move(samples), 0, { { "workers", (double)workers }, { "items", (double)items },
+					{ "syscalls_per_item", syscalls / n }, { "cpu_ns_per_item", cpu / n } });
+			}
+		}
+
+		name = prefix + ".idle_tick";
+		if (ctx.wanted(name))
+		{
+			auto loop = remote::event_loop::create(kind);
+			std::vector<int> pids;
+			int go = -1;
+			if (!start_pool(workers, pids, go))
+			{
+				stop_pool(pids, go);
+				return;
+			}
+			for (auto pid : pids)
+				loop->watch_child(pid, [](int, int) {});
+
+			// the whole pool watched, nothing happening: what one tick costs
+			std::vector<double> samples(ctx.iterations(200));
+			auto before = loop->stats().syscalls;
+			auto cpu_before = cpu_ns();
+			for (auto& sample : samples)
+			{
+				auto start = bench::clock::now();
+				loop->run_once(std::chrono::milliseconds{ 1 });
+				sample = (double)bench::elapsed_ns(start);
+			}
+			double n = (double)samples.size();
+			double syscalls = (double)(loop->stats().syscalls - before) / n;
+			double cpu = (double)(cpu_ns() - cpu_before) / n;
+			ctx.report(name, std::move(samples), 0, { { "workers", (double)workers },
+				{ "syscalls_per_tick", syscalls }, { "cpu_ns_per_tick", cpu } });
+
+			loop.reset();
+			stop_pool(pids, go);
+		}
+	}
+}
+
+BENCH(event_loop)
+{
+	auto log = bench::temp_path("event_loop.log");
+	for (auto kind : { remote::event_loop::kind::io_uring, remote::event_loop::kind::epoll })
+	{
+		for (size_t workers : { 100, 1000, 4000 })
+			run(ctx, kind, workers, log);
+	}
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The lookup behind change_identity(): resolve_identity() of the user the
+ * benchmark runs as, with the cache emptied before each call (passwd and
+ * group lookups, nss and all) and answered from the cache. Changing the
+ * identity itself cannot be undone, so it is not measured.
+ */
+
+#include "bench.hpp"
+#include <remote/identity.hpp>
+#include <pwd.h>
+#include <unistd.h>
+
+BENCH(identity)
+{
+	auto user = getpwuid(getuid());
+	if (!user)
+	{
+		fprintf(stderr, "identity: no passwd entry for uid %u\n", (unsigned)getuid());
+		return;
+	}
+	std::string name = user->pw_name;
+
+	if (ctx.wanted("identity.resolve.cold"))
+	{
+		std::vector<double> samples(ctx.iterations(5000));
+		for (auto& sample : samples)
+		{
+			remote::forget_identities();
+			remote::credentials creds;
+			auto start = bench::clock::now();
+			remote::resolve_identity(name.c_str(), nullptr, creds);
+			sample = (double)bench::elapsed_ns(start);
+		}
+		ctx.report("identity.resolve.cold", std::move(samples));
+	}
+
+	if (ctx.wanted("identity.resolve.cached"))
+	{
+		remote::credentials creds;
+		remote::resolve_identity(name.c_str(), nullptr, creds);
+
+		std::vector<double> samples(ctx.iterations(100000));
+		for (auto& sample : samples)
+		{
+			auto start = bench::clock::now();
+			remote::resolve_identity(name.c_str(), nullptr, creds);
+			sample = (double)bench::elapsed_ns(start);
+		}
+		ctx.report("identity.resolve.cached", std::move(samples));
+	}
+
+	remote::forget_identities();
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * LOG() with a logger which drops the line (the cost of building it) and
+ * with file_logger (building plus handing it to the writer thread).
+ * Throughput is one long loop; latency times every line on its own.
+ */
+
+#include "bench.hpp"
+#include <remote/file_logger.hpp>
+
+namespace
+{
+	struct null_logger : remote::logger
+	{
+		void write(const char*, int, std::string_view) override {}
+	};
+
+	void measure(bench::context& ctx, const std::string& name, const remote::logger_ptr& log)
+	{
+		if (ctx.wanted(name + ".throughput"))
+		{
+			auto count = ctx.iterations(1000000);
+			auto start = bench::clock::now();
+			for (size_t i = 0; i < count; ++i)
+				LOG(log) << "request " << i << " served in " << 1.5 << "ms by worker " << (int)(i % 64);
+			auto ns = (double)bench::elapsed_ns(start);
+			ctx.report(name + ".throughput", { { "ns_per_line", ns / (double)count }, { "lines_per_sec", (double)count * 1e9 / ns } });
+		}
+
+		if (ctx.wanted(name + ".latency"))
+		{
+			std::vector<double> samples(ctx.iterations(200000));
+			for (size_t i = 0; i < samples.size(); ++i)
+			{
+				auto start = bench::clock::now();
+				LOG(log) << "request " << i << " served in " << 1.5 << "ms by worker " << (int)(i % 64);
+				samples[i] = (double)bench::elapsed_ns(start);
+			}
+			ctx.report(name + ".latency", std::move(samples));
+		}
+	}
+}
+
+BENCH(log)
+{
+	measure(ctx, "log.null", std::make_shared<null_logger>());
+
+	remote::file_log_config config;
+	config.path = bench::temp_path("bench.log");
+	auto file = std::make_shared<remote::file_logger>(config);
+	if (!*file)
+	{
+		fprintf(stderr, "%s: cannot be opened\n", config.path.c_str());
+		return;
+	}
+	measure(ctx, "log.file", file);
+
+	auto start = bench::clock::now();
+	file->flush();
+	if (ctx.wanted("log.file.flush"))
+		ctx.report("log.file.flush", { { "ns", (double)bench::elapsed_ns(start) } });
+}
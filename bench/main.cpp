@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Micro-benchmarks of the libremote subsystems:
+ *
+ *   libremote_bench [--quick] [--list] [filter...]
+ *
+ * Runs every benchmark whose name (or the name of one of its results)
+ * contains one of the filters, all of them without a filter, and prints
+ * a single JSON document:
+ *
+ *   { "suite": "libremote_bench", "version": 1, "host": { ... },
+ *     "results": [ { "name": "log.null.latency", "unit": "ns", "samples": ...,
+ *                    "min": ..., "mean": ..., "p50": ..., "p90": ..., "p99": ...,
+ *                    "p999": ..., "max": ..., "ops_per_sec": ... }, ... ] }
+ *
+ * Progress goes to stderr, so the output can be kept for comparing releases.
+ */
+
+#include "bench.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace bench
+{
+	namespace
+	{
+		std::vector<std::string> s_filters;
+		std::string s_temp_dir;
+		std::vector<std::string> s_temp_files;
+		FILE* s_out = stdout;
+		bool s_first = true;
+
+		bool matches(const std::string& name)
+		{
+			if (s_filters.empty())
+				return true;
+			for (auto&& filter : s_filters)
+			{
+				if (name.find(filter) != std::string::npos)
+					return true;
+			}
+			return false;
+		}
+
+		double percentile(const std::vector<double>& sorted, double p)
+		{
+			if (sorted.empty())
+				return 0;
+			auto at = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+			return sorted[std::min(at, sorted.size() - 1)];
+		}
+
+		void remove_temp()
+		{
+			for (auto&& path : s_temp_files)
+			{
+				unlink(path.c_str());
+				for (int i = 1; i < 10; ++i)
+					unlink((path + "." + std::to_string(i)).c_str());
+			}
+			if (!s_temp_dir.empty())
+				rmdir(s_temp_dir.c_str());
+		}
+	}
+
+	std::vector<std::pair<const char*, registrar::function>>& registry()
+	{
+		static std::vector<std::pair<const char*, registrar::function>> benches;
+		return benches;
+	}
+
+	registrar::registrar(const char* name, function fn)
+	{
+		registry().emplace_back(name, fn);
+	}
+
+	bool context::wanted(const std::string& name) const
+	{
+		return m_filter.empty() || matches(name);
+	}
+
+	void context::report(const std::string& name, std::vector<double> samples, double ops_per_sec, const params& extra)
+	{
+		if (!wanted(name))
+			return;
+
+		std::sort(samples.begin(), samples.end());
+		double sum = 0;
+		for (auto sample : samples)
+			sum += sample;
+
+		fprintf(s_out, "%s\n    {\"name\":\"%s\",\"unit\":\"ns\",\"samples\":%zu,\"min\":%.1f,\"mean\":%.1f,"
+			"\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f",
+			s_first ? "" : ",", name.c_str(), samples.size(),
+			samples.empty() ? 0.0 : samples.front(), samples.empty() ? 0.0 : sum / (double)samples.size(),
+			percentile(samples, 0.5), percentile(samples, 0.9), percentile(samples, 0.99),
+			percentile(samples, 0.999), samples.empty() ? 0.0 : samples.back());
+		if (ops_per_sec)
+			fprintf(s_out, ",\"ops_per_sec\":%.0f", ops_per_sec);
+		for (auto&& value : extra)
+			fprintf(s_out, ",\"%s\":%g", value.first, value.second);
+		fprintf(s_out, "}");
+		fflush(s_out);
+		s_first = false;
+
+		fprintf(stderr, "%-40s p50 %10.1f ns  p99 %10.1f ns\n", name.c_str(), percentile(samples, 0.5), percentile(samples, 0.99));
+	}
+
+	void context::report(const std::string& name, const params& values)
+	{
+		if (!wanted(name))
+			return;
+
+		fprintf(s_out, "%s\n    {\"name\":\"%s\"", s_first ? "" : ",", name.c_str());
+		for (auto&& value : values)
+			fprintf(s_out, ",\"%s\":%g", value.first, value.second);
+		fprintf(s_out, "}");
+		fflush(s_out);
+		s_first = false;
+
+		fprintf(stderr, "%s\n", name.c_str());
+	}
+
+	std::string temp_path(const char* name)
+	{
+		if (s_temp_dir.empty())
+		{
+			char dir[] = "/tmp/libremote_bench.XXXXXX";
+			if (!mkdtemp(dir))
+			{
+				perror("mkdtemp");
+				exit(1);
+			}
+			s_temp_dir = dir;
+			atexit(remove_temp);
+		}
+
+		auto path = s_temp_dir + "/" + name;
+		s_temp_files.push_back(path);
+		return path;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool quick = false;
+	bool list = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--quick"))
+			quick = true;
+		else if (!strcmp(argv[i], "--list"))
+			list = true;
+		else if (argv[i][0] == '-')
+		{
+			fprintf(stderr, "usage: %s [--quick] [--list] [filter...]\n", argv[0]);
+			return 2;
+		}
+		else
+			bench::s_filters.push_back(argv[i]);
+	}
+
+	// the order of the static registrars depends on the linker
+	auto& benches = bench::registry();
+	std::sort(benches.begin(), benches.end(), [](const auto& lhs, const auto& rhs) { return strcmp(lhs.first, rhs.first) < 0; });
+
+	if (list)
+	{
+		for (auto&& entry : benches)
+			printf("%s\n", entry.first);
+		return 0;
+	}
+
+	utsname host;
+	if (uname(&host))
+		memset(&host, 0, sizeof(host));
+
+	fprintf(bench::s_out, "{\n  \"suite\":\"libremote_bench\",\"version\":1,\n"
+		"  \"host\":{\"cpus\":%u,\"system\":\"%s\",\"release\":\"%s\",\"machine\":\"%s\"},\n"
+		"  \"quick\":%s,\n  \"results\":[",
+		std::thread::hardware_concurrency(), host.sysname, host.release, host.machine,
+		quick ? "true" : "false");
+
+	// a benchmark named by a filter runs all of its results, otherwise
+	// only the results matching the filters are reported
+	for (auto&& entry : benches)
+	{
+		bench::context ctx{ bench::matches(entry.first) ? std::string{} : std::string{ "*" } };
+		ctx.scale = quick ? 10 : 1;
+		entry.second(ctx);
+	}
+
+	fprintf(bench::s_out, "\n  ]\n}\n");
+	fflush(bench::s_out);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Opening the listener the workers inherit (socket, bind, listen) the way
+ * respawn::listen() does it, for each address probe. The connect probe is
+ * run against a port nobody listens on, which is the common case.
+ */
+
+#include "bench.hpp"
+#include <remote/respawn.hpp>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace
+{
+	// a port the kernel just gave out and took back, so nothing is listening there
+	std::string free_address()
+	{
+		remote::respawn::options opts;
+		opts.address_probe = remote::respawn::probe::bind;
+		auto fd = remote::respawn::listen("127.0.0.1:0", opts);
+
+		sockaddr_in addr{};
+		socklen_t length = sizeof(addr);
+		getsockname(fd, (sockaddr*)&addr, &length);
+		remote::os::close(fd);
+		return "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+	}
+}
+
+BENCH(open)
+{
+	using probe = remote::respawn::probe;
+	const std::pair<const char*, probe> probes[] = {
+		{ "open.connect", probe::connect },
+		{ "open.bind", probe::bind },
+		{ "open.reuseport", probe::reuseport },
+	};
+
+	for (auto&& entry : probes)
+	{
+		if (!ctx.wanted(entry.first))
+			continue;
+
+		remote::respawn::options opts;
+		opts.address_probe = entry.second;
+
+		try
+		{
+			auto address = free_address();
+			std::vector<double> samples(ctx.iterations(5000));
+			for (auto& sample : samples)
+			{
+				auto start = bench::clock::now();
+				auto fd = remote::respawn::listen(address, opts);
+				sample = (double)bench::elapsed_ns(start);
+				remote::os::close(fd);
+			}
+			ctx.report(entry.first, std::move(samples));
+		}
+		catch (remote::spawn_error& err)
+		{
+			fprintf(stderr, "%s: %s\n", entry.first, err.what());
+		}
+	}
+}
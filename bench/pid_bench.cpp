@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The pid file: creating, locking and writing it (and removing it again,
+ * when the object goes), reading it back and checking its lock.
+ */
+
+#include "bench.hpp"
+#include <remote/pid.hpp>
+
+BENCH(pid)
+{
+	auto path = bench::temp_path("bench.pid");
+
+	if (ctx.wanted("pid.write"))
+	{
+		std::vector<double> samples(ctx.iterations(20000));
+		for (auto& sample : samples)
+		{
+			auto start = bench::clock::now();
+			{
+				remote::pid file{ path };
+			}
+			sample = (double)bench::elapsed_ns(start);
+		}
+		ctx.report("pid.write", std::move(samples));
+	}
+
+	remote::pid file{ path };
+
+	if (ctx.wanted("pid.read"))
+	{
+		std::vector<double> samples(ctx.iterations(50000));
+		for (auto& sample : samples)
+		{
+			int value = 0;
+			auto start = bench::clock::now();
+			remote::pid::read(path, value);
+			sample = (double)bench::elapsed_ns(start);
+		}
+		ctx.report("pid.read", std::move(samples));
+	}
+
+	if (ctx.wanted("pid.is_running"))
+	{
+		std::vector<double> samples(ctx.iterations(50000));
+		for (auto& sample : samples)
+		{
+			auto start = bench::clock::now();
+			remote::pid::is_running(path);
+			sample = (double)bench::elapsed_ns(start);
+		}
+		ctx.report("pid.is_running", std::move(samples));
+	}
+}
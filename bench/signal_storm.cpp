@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Bursts of signals at a process which takes them through remote::signals:
+ *
+ *   signal_storm [bursts [burst_size [gap_us [late_ms]]]]
+ *
+ * Each mechanism the library has for sending gets the same storm, one
+ * after the other, round robin over a few signals within a burst:
+ *
+ *   kill     signals::signal() with SIGUSR1, SIGUSR2, SIGHUP, SIGWINCH
+ *   group    signals::signal_group() with the same, to the receiver's group
+ *   queue    signals::queue() with rt1 .. rt4, the value numbering the sends
+ *   command  signals::command(), received through on_command()
+ *
+ * The standard signals are merged by the kernel while one is pending, so
+ * the sends which got no delivery of their own are counted as coalesced;
+ * such a signal is lost only, if its very last send was never followed by
+ * a delivery. Queued signals and commands must all arrive; what does not
+ * is lost, what comes before a value sent earlier is out of order. Latency
+ * runs from the send (for the standard signals, the latest send of that
+ * signal) to the handler on the dispatcher thread; a delivery slower than
+ * late_ms is late. The report is printed as JSON, one object per mechanism.
+ */
+
+#include <remote/signals.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+	enum mechanism { kill_signal, group_signal, queue_signal, command_signal, mechanisms };
+
+	const char* name(int m)
+	{
+		switch (m)
+		{
+		case kill_signal: return "kill";
+		case group_signal: return "group";
+		case queue_signal: return "queue";
+		case command_signal: return "command";
+		}
+		return "?";
+	}
+
+	const char* const plain[] = { "SIGUSR1", "SIGUSR2", "SIGHUP", "SIGWINCH" };
+	const char* const realtime[] = { "rt1", "rt2", "rt3", "rt4" };
+	constexpr int kinds = 4;
+	constexpr size_t max_sends = 1 << 17;
+
+	struct shared_state
+	{
+		std::atomic<bool> ready;
+		std::atomic<bool> stop;
+		std::atomic<int> phase;
+
+		// by signal, for the standard ones: when it was sent and handled last
+		std::atomic<int64_t> last_sent[kinds];
+		std::atomic<int64_t> last_handled[kinds];
+
+		// by phase
+		std::atomic<uint64_t> delivered[mechanisms];
+		std::atomic<uint64_t> out_of_order[mechanisms];
+		std::atomic<int64_t> last_value[mechanisms][kinds];
+
+		int64_t sent_at[mechanisms][max_sends];
+		int64_t latency[mechanisms][max_sends];
+	};
+
+	struct quiet_logger : remote::logger
+	{
+		void write(const char*, int, std::string_view) override {}
+	};
+
+	int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void record(shared_state* shared, int phase, int64_t sent)
+	{
+		auto index = shared->delivered[phase].fetch_add(1);
+		if (index < max_sends)
+			shared->latency[phase][index] = now() - sent;
+	}
+
+	void sequenced(shared_state* shared, int phase, int kind, int64_t value)
+	{
+		if (value < 0 || (size_t)value >= max_sends)
+			return;
+
+		if (value < shared->last_value[phase][kind].load())
+			++shared->out_of_order[phase];
+		shared->last_value[phase][kind] = value;
+		record(shared, phase, shared->sent_at[phase][value]);
+	}
+
+	void receiver(shared_state* shared)
+	{
+		setpgid(0, 0);
+
+		remote::signals sig{ std::make_shared<quiet_logger>() };
+		for (int kind = 0; kind < kinds; ++kind)
+		{
+			sig.subscribe(plain[kind], [=]
+			{
+				shared->last_handled[kind] = now();
+				record(shared, shared->phase.load(), shared->last_sent[kind].load());
+			});
+
+			sig.subscribe(realtime[kind], [=](const remote::signal_info& info)
+			{
+				if (info.queued)
+					sequenced(shared, queue_signal, kind, info.value);
+			});
+		}
+
+		sig.on_command([=](remote::command, unsigned arg, int)
+		{
+			sequenced(shared, command_signal, 0, arg);
+		});
+
+		shared->ready = true;
+		while (!shared->stop)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	// until nothing came for a while
+	void settle(shared_state* shared, int phase)
+	{
+		auto last = shared->delivered[phase].load();
+		for (int quiet = 0; quiet < 10;)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			auto next = shared->delivered[phase].load();
+			quiet = next == last ? quiet + 1 : 0;
+			last = next;
+		}
+	}
+
+	void run(shared_state* shared, remote::signals& sig, int pid, int m, int bursts, int burst, int gap_us, int late_ms)
+	{
+		shared->phase = m;
+		for (int kind = 0; kind < kinds; ++kind)
+		{
+			shared->last_sent[kind] = 0;
+			shared->last_handled[kind] = 0;
+			shared->last_value[m][kind] = -1;
+		}
+
+		uint64_t sent = 0;
+		uint64_t refused = 0;
+		for (int b = 0; b < bursts; ++b)
+		{
+			for (int i = 0; i < burst && sent + refused < max_sends; ++i)
+			{
+				auto kind = i % kinds;
+				auto seq = sent;
+				bool ok = false;
+
+				switch (m)
+				{
+				case kill_signal:
+					shared->last_sent[kind] = now();
+					ok = sig.signal(plain[kind], pid);
+					break;
+				case group_signal:
+					shared->last_sent[kind] = now();
+					ok = sig.signal_group(plain[kind], pid);
+					break;
+				case queue_signal:
+					shared->sent_at[m][seq] = now();
+					ok = sig.queue(realtime[kind], pid, (int)seq);
+					break;
+				case command_signal:
+					shared->sent_at[m][seq] = now();
+					ok = sig.command(pid, remote::command::user, (unsigned)seq);
+					break;
+				}
+
+				if (ok)
+					++sent;
+				else
+					++refused;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(gap_us));
+		}
+
+		settle(shared, m);
+
+		uint64_t delivered = shared->delivered[m].load();
+		std::vector<int64_t> latency(shared->latency[m], shared->latency[m] + std::min<uint64_t>(delivered, max_sends));
+		std::sort(latency.begin(), latency.end());
+		auto pct = [&](double p) { return latency.empty() ? 0.0 : latency[(size_t)(p * (double)(latency.size() - 1))] / 1000.0; };
+		auto late = latency.end() - std::lower_bound(latency.begin(), latency.end(), (int64_t)late_ms * 1000000);
+
+		bool merged = m == kill_signal || m == group_signal;
+		uint64_t lost = 0;
+		uint64_t coalesced = 0;
+		if (merged)
+		{
+			coalesced = sent > delivered ? sent - delivered : 0;
+			for (int kind = 0; kind < kinds; ++kind)
+			{
+				if (shared->last_sent[kind] && shared->last_handled[kind] < shared->last_sent[kind])
+					++lost;
+			}
+		}
+		else
+			lost = sent > delivered ? sent - delivered : 0;
+
+		printf("{\"mechanism\":\"%s\",\"bursts\":%d,\"burst\":%d,\"gap_us\":%d,\"sent\":%llu,\"refused\":%llu,"
+			"\"delivered\":%llu,\"coalesced\":%llu,\"coalescing_rate\":%.4f,\"lost\":%llu,\"out_of_order\":%llu,"
+			"\"late\":%lld,\"late_ms\":%d,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+			name(m), bursts, burst, gap_us, (unsigned long long)sent, (unsigned long long)refused,
+			(unsigned long long)delivered, (unsigned long long)coalesced, sent ? (double)coalesced / (double)sent : 0.0,
+			(unsigned long long)lost, (unsigned long long)shared->out_of_order[m].load(),
+			(long long)late, late_ms, pct(0.5), pct(0.9), pct(0.99), latency.empty() ? 0.0 : latency.back() / 1000.0);
+		fflush(stdout);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int bursts = argc > 1 ? atoi(argv[1]) : 200;
+	int burst = argc > 2 ? atoi(argv[2]) : 64;
+	int gap_us = argc > 3 ? atoi(argv[3]) : 1000;
+	int late_ms = argc > 4 ? atoi(argv[4]) : 10;
+
+	auto shared = (shared_state*)mmap(nullptr, sizeof(shared_state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	new (shared) shared_state{};
+
+	pid_t pid = fork();
+	if (!pid)
+	{
+		receiver(shared);
+		_exit(0);
+	}
+
+	while (!shared->ready)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	remote::signals sig{ std::make_shared<quiet_logger>() };
+	for (int m = 0; m < mechanisms; ++m)
+		run(shared, sig, pid, m, bursts, burst, gap_us, late_ms);
+
+	shared->stop = true;
+	waitpid(pid, nullptr, 0);
+	munmap(shared, sizeof(shared_state));
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * remote::signals: the cost of set() (which replaces the handler, so it
+ * subscribes and unsubscribes) and the time from kill() or sigqueue() to
+ * the handler running on the dispatcher thread.
+ */
+
+#include "bench.hpp"
+#include <remote/signals.hpp>
+#include <atomic>
+#include <signal.h>
+#include <unistd.h>
+
+namespace
+{
+	struct quiet_logger : remote::logger
+	{
+		void write(const char*, int, std::string_view) override {}
+	};
+
+	template <typename Send>
+	void dispatch(bench::context& ctx, const std::string& name, remote::signals& sig, const char* signame, Send send)
+	{
+		if (!ctx.wanted(name))
+			return;
+
+		std::atomic<int64_t> handled{ 0 };
+		auto token = sig.subscribe(signame, [&] { handled.store(bench::clock::now().time_since_epoch().count(), std::memory_order_release); });
+
+		std::vector<double> samples(ctx.iterations(20000));
+		for (auto& sample : samples)
+		{
+			handled.store(0, std::memory_order_relaxed);
+			auto start = bench::clock::now();
+			send();
+			int64_t stamp;
+			while (!(stamp = handled.load(std::memory_order_acquire)))
+				;
+			sample = (double)(stamp - start.time_since_epoch().count());
+		}
+
+		sig.unsubscribe(token);
+		ctx.report(name, std::move(samples));
+	}
+}
+
+BENCH(signals)
+{
+	remote::signals sig{ std::make_shared<quiet_logger>() };
+
+	if (ctx.wanted("signals.set"))
+	{
+		std::vector<double> samples(ctx.iterations(20000));
+		for (auto& sample : samples)
+		{
+			auto start = bench::clock::now();
+			sig.set("SIGUSR1", [] {});
+			sample = (double)bench::elapsed_ns(start);
+		}
+		ctx.report("signals.set", std::move(samples));
+	}
+
+	auto self = getpid();
+	dispatch(ctx, "signals.dispatch.kill", sig, "SIGUSR2", [&] { sig.signal("SIGUSR2", self); });
+	dispatch(ctx, "signals.dispatch.queue", sig, "rt2", [&] { sig.queue("rt2", self, 1); });
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Spawn latency against the size of the parent: the time from the call
+ * until the worker got through exec(), with the spawner holding 0 to 1024
+ * MB of touched memory. A fork() has to copy the page tables of all of it,
+ * so this is what a big supervisor pays per worker. os::spawn() is the
+ * launch of os::fcgi() which returns the pid, so the worker (a sleep, so
+ * it is still there when the spawner checks on it) can be stopped again.
+ */
+
+#include "bench.hpp"
+#include <remote/respawn.hpp>
+#include <cstring>
+#include <memory>
+#include <sys/wait.h>
+
+BENCH(spawn)
+{
+	remote::respawn::options opts;
+	opts.address_probe = remote::respawn::probe::bind;
+
+	int listener = -1;
+	try
+	{
+		listener = remote::respawn::listen("127.0.0.1:0", opts);
+	}
+	catch (remote::spawn_error& err)
+	{
+		fprintf(stderr, "spawn: %s\n", err.what());
+		return;
+	}
+
+	remote::spawn_template tmpl;
+	tmpl.args = { "/bin/sleep", "3600" };
+
+	for (size_t rss_mb : { 0, 64, 256, 1024 })
+	{
+		auto name = "spawn.rss_" + std::to_string(rss_mb) + "mb";
+		if (!ctx.wanted(name))
+			continue;
+
+		// touched, so the pages are really there to be mapped into the child
+		std::unique_ptr<char[]> ballast;
+		if (rss_mb)
+		{
+			ballast.reset(new (std::nothrow) char[rss_mb << 20]);
+			if (!ballast)
+			{
+				fprintf(stderr, "%s: out of memory\n", name.c_str());
+				continue;
+			}
+			memset(ballast.get(), 1, rss_mb << 20);
+		}
+
+		std::vector<double> samples(ctx.iterations(200));
+		for (auto& sample : samples)
+		{
+			auto start = bench::clock::now();
+			auto pid = remote::os::spawn(listener, tmpl);
+			sample = (double)bench::elapsed_ns(start);
+
+			if (pid < 0)
+			{
+				fprintf(stderr, "%s: os::spawn failed\n", name.c_str());
+				break;
+			}
+
+			remote::os::terminate(pid, true);
+			int status;
+			while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+				;
+		}
+
+		ctx.report(name, std::move(samples), 0, { { "rss_mb", (double)rss_mb } });
+	}
+
+	remote::os::close(listener);
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The supervisor's own cost with thousands of workers, measured against
+ * remote::simulation: the workers are simulated, the supervisor is not.
+ * A run goes through the phases
+ *
+ *   start     every worker spawned (one sample, the whole apply())
+ *   steady    nothing happens, the pools are only looked after
+ *   crash     a tenth of the workers die at once, are reaped and respawned
+ *   resize    a reload which grows every pool by a tenth
+ *   restart   a reload which changes the exec line of one pool
+ *   shutdown  SIGTERM to all, reaping them until none is left (one sample)
+ *
+ * and reports the real time of the supervisor's ticks in each of them.
+ * The seed is fixed, so every run does the same work.
+ */
+
+#include "bench.hpp"
+#include <remote/simulation.hpp>
+#include <remote/supervisor.hpp>
+#include <fstream>
+#include <map>
+
+namespace
+{
+	struct quiet_logger : remote::logger
+	{
+		void write(const char*, int, std::string_view) override {}
+	};
+
+	constexpr size_t pools = 10;
+
+	void write_config(const std::string& path, size_t per_pool, const char* exec_of_first)
+	{
+		std::ofstream out{ path, std::ios::trunc };
+		for (size_t i = 0; i < pools; ++i)
+		{
+			out << "[pool" << i << "]\n"
+				<< "address = 127.0.0.1:" << 9000 + i << '\n'
+				<< "exec = " << (i ? "/usr/bin/worker" : exec_of_first) << " --pool " << i << '\n'
+				<< "workers = " << per_pool << "\n\n";
+		}
+	}
+
+	void run(bench::context& ctx, size_t workers)
+	{
+		auto prefix = "supervisor.sim." + std::to_string(workers);
+		if (!ctx.wanted(prefix))
+			return;
+
+		auto config = bench::temp_path(("supervisor" + std::to_string(workers) + ".conf").c_str());
+		auto per_pool = workers / pools;
+		write_config(config, per_pool, "/usr/bin/worker");
+
+		remote::simulation_config sim_config;
+		sim_config.seed = 42;
+		auto sim = std::make_shared<remote::simulation>(sim_config);
+
+		std::map<std::string, std::vector<double>> phases;
+		std::string phase = "start";
+		auto started = bench::clock::now();
+
+		sim->on_tick = [&](std::chrono::nanoseconds busy) { phases[phase].push_back((double)busy.count()); };
+
+		using std::chrono::milliseconds;
+		sim->at(milliseconds{ 0 }, [&](remote::simulation&)
+		{
+			phases["start"].push_back((double)bench::elapsed_ns(started));
+			phase = "steady";
+		});
+		sim->at(milliseconds{ 2000 }, [&](remote::simulation& s)
+		{
+			phase = "crash";
+			s.crash(0.1);
+		});
+		sim->at(milliseconds{ 4000 }, [&](remote::simulation& s)
+		{
+			phase = "resize";
+			write_config(config, per_pool + per_pool / 10, "/usr/bin/worker");
+			s.raise("reload");
+		});
+		sim->at(milliseconds{ 6000 }, [&](remote::simulation& s)
+		{
+			phase = "restart";
+			write_config(config, per_pool + per_pool / 10, "/usr/bin/worker-v2");
+			s.raise("reload");
+		});
+		bench::clock::time_point stopping;
+		sim->at(milliseconds{ 8000 }, [&](remote::simulation& s)
+		{
+			phase = "shutdown";
+			stopping = bench::clock::now();
+			s.raise("stop");
+		});
+
+		{
+			remote::supervisor super{ std::make_shared<quiet_logger>(), config, sim };
+			super.run();
+		}
+
+		// the last ticks of the shutdown do not end in a wait(); the phase is
+		// taken as a whole instead
+		phases["shutdown"] = { (double)bench::elapsed_ns(stopping) };
+
+		for (auto name : { "start", "steady", "crash", "resize", "restart", "shutdown" })
+		{
+			auto& samples = phases[name];
+			double total = 0;
+			for (auto sample : samples)
+				total += sample;
+			ctx.report(prefix + "." + name, std::move(samples), 0, { { "workers", (double)workers }, { "total_ns", total } });
+		}
+
+		auto& stats = sim->stats();
+		ctx.report(prefix + ".counters", {
+			{ "workers", (double)workers },
+			{ "spawned", (double)stats.spawned },
+			{ "reaped", (double)stats.reaped },
+			{ "terminated", (double)stats.terminated },
+			{ "killed", (double)stats.killed },
+			{ "ticks", (double)stats.ticks },
+			{ "real_ns", (double)bench::elapsed_ns(started) },
+		});
+	}
+}
+
+BENCH(supervisor)
+{
+	for (size_t workers : { 1000, 10000, 50000 })
+		run(ctx, workers / ctx.scale);
+}
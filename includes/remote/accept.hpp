@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_ACCEPT_HPP__
+#define __LIBREMOTE_ACCEPT_HPP__
+
+#include <atomic>
+
+namespace remote
+{
+	/*
+	 * Serialises accept() between the workers sharing one listener, in the
+	 * spirit of nginx's accept_mutex: only the worker holding the lock waits
+	 * on the listener, the rest keep serving their own connections.
+	 *
+	 * The supervisor creates the mutex before spawning; the workers attach to
+	 * it with inherit(), which reads the descriptor from LIBREMOTE_ACCEPT_MUTEX.
+	 */
+	class accept_mutex
+	{
+		struct shared
+		{
+			std::atomic<int> owner;   // pid of the holder, 0 if free; the futex word
+			std::atomic<int> waiters; // sleeping in lock()
+		};
+
+		int m_fd = -1;
+		shared* m_shared = nullptr;
+
+		explicit accept_mutex(int fd);
+	public:
+		static constexpr const char* env_name = "LIBREMOTE_ACCEPT_MUTEX";
+
+		accept_mutex();
+		~accept_mutex();
+		accept_mutex(const accept_mutex&) = delete;
+		accept_mutex& operator=(const accept_mutex&) = delete;
+		accept_mutex(accept_mutex&& oth);
+
+		static accept_mutex inherit();
+
+		explicit operator bool() const { return !!m_shared; }
+		int fd() const { return m_fd; }
+
+		// a mutex which failed to attach (see operator bool), or was moved
+		// from, is never taken: try_lock and lock return false. A holder which
+		// died (crashed, SIGKILLed) does not wedge the pool: both take the lock
+		// over from a pid which is gone. lock() sleeps on a futex meanwhile,
+		// waking up now and then to look for a dead holder
+		bool try_lock();
+		bool lock();
+		void unlock();
+
+		// frees the lock, if pid holds it; for a caller which knows pid is gone
+		// sooner than the next try_lock() would find out
+		bool force_unlock(int pid);
+	};
+
+	// registers the listener in the epoll set with EPOLLEXCLUSIVE,
+	// so a new connection wakes up one waiter instead of all of them;
+	// returns false, where not supported
+	bool watch_exclusive(int epoll_fd, int listener);
+}
+
+#endif // __LIBREMOTE_ACCEPT_HPP__
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_BACKEND_HPP__
+#define __LIBREMOTE_BACKEND_HPP__
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "capture.hpp"
+#include "event_loop.hpp"
+#include "logger.hpp"
+#include "respawn.hpp"
+#include "signals.hpp"
+
+namespace remote
+{
+	namespace os
+	{
+		/*
+		 * What the supervisor asks of the operating system: the clock, the
+		 * listeners, the workers' lives and the signals. native() forwards to
+		 * the functions of os:: (and respawn::listen); remote::simulation
+		 * fakes all of it, so the supervisor can be run with any number of
+		 * workers, in virtual time.
+		 *
+		 * The native backend waits in an event_loop: it collects the exits of
+		 * the workers it spawned and wakes up for their output, so a tick costs
+		 * the same few system calls with ten workers as with ten thousand.
+		 */
+		struct backend
+		{
+			using clock = std::chrono::steady_clock;
+
+			virtual ~backend() {}
+
+			virtual clock::time_point now() = 0;
+
+			// the sleep between two ticks of the supervisor; the native one moves
+			// the output of the workers meanwhile
+			virtual void wait(output_capture& output, std::chrono::milliseconds timeout) = 0;
+
+			// wait() ends as soon as fd is readable, until unwatch(); for the
+			// doorbells of the control channels, which the caller drains itself
+			virtual bool watch(int fd) = 0;
+			virtual void unwatch(int fd) = 0;
+
+			virtual signals_ptr create_signals(const logger_ptr& log) = 0;
+
+			// throws spawn_error
+			virtual int listen(const std::string& address) = 0;
+			virtual void close(int socket) = 0;
+
+			// see os::spawn, os::reap, os::terminate, os::process_group
+			virtual int spawn(int stdIn, const spawn_template& tmpl) = 0;
+			virtual int reap(int& status) = 0;
+			virtual bool terminate(int pid, bool force) = 0;
+			virtual int process_group(int pid) = 0;
+		};
+		using backend_ptr = std::shared_ptr<backend>;
+
+		// a new one on every call, each with its own loop
+		backend_ptr native(event_loop::kind loop = event_loop::kind::automatic);
+	}
+}
+
+#endif // __LIBREMOTE_BACKEND_HPP__
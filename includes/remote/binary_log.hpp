@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_BINARY_LOG_HPP__
+#define __LIBREMOTE_BINARY_LOG_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace remote
+{
+	/*
+	 * Layout of the binary log, in the byte order of the writer:
+	 *
+	 *   header: "LRBL" | uint32 version
+	 *   'S' site:  uint32 id | uint32 line | uint32 length | file
+	 *   'E' line:  uint32 site | int64 time | uint32 length | arguments, see log_arg
+	 *   'T' text:  int64 time | uint32 line | uint32 length | file | uint32 length | text
+	 *
+	 * A site is described before the first line which uses it. Time is unix
+	 * time in nanoseconds. Text records come from the LOG()s which were built
+	 * without a log_site.
+	 */
+	namespace binary_log
+	{
+		enum : uint32_t
+		{
+			magic = 0x4c42524c, // "LRBL"
+			version = 1
+		};
+
+		enum : char
+		{
+			site = 'S',
+			line = 'E',
+			text = 'T'
+		};
+
+		struct entry
+		{
+			int64_t time = 0;
+			std::string file;
+			int line = 0;
+			std::string text;
+		};
+
+		class reader
+		{
+			FILE* m_file = nullptr;
+			bool m_valid = false;
+			std::vector<std::pair<std::string, int>> m_sites;
+			std::string m_args;
+		public:
+			explicit reader(const std::string& path);
+			~reader();
+			reader(const reader&) = delete;
+			reader& operator=(const reader&) = delete;
+
+			explicit operator bool() const { return m_valid; }
+
+			// false at the end of the log, or at the first damaged record
+			bool next(entry& out);
+		};
+	}
+
+	// keeps the arguments in memory and writes them out in 64k chunks;
+	// whatever is still buffered is lost, if the process dies
+	class binary_logger : public logger
+	{
+		std::mutex m_mutex;
+		FILE* m_file = nullptr;
+		std::string m_buffer;
+		std::vector<bool> m_described;
+
+		void describe(const log_site& site, uint32_t id);
+		void flush_locked();
+	public:
+		explicit binary_logger(const std::string& path);
+		~binary_logger();
+
+		explicit operator bool() const { return !!m_file; }
+
+		void write(const char* path, int line, std::string_view text) override;
+		void write(const log_site& site, std::string_view args) override;
+		void flush();
+	};
+}
+
+#endif // __LIBREMOTE_BINARY_LOG_HPP__
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_CAPTURE_HPP__
+#define __LIBREMOTE_CAPTURE_HPP__
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace remote
+{
+	struct output_config
+	{
+		enum class target
+		{
+			discard, // /dev/null, as before
+			file,    // spliced into the worker's own file ("{pid}" in the path); a shared one is tagged, see below
+			logger   // line by line, tagged with the pool and the pid of the worker
+		};
+
+		target to = target::discard;
+		std::string path;                  // for target::file; "{pid}" is replaced with the pid of the worker
+		size_t pipe_size = 1024 * 1024;    // F_SETPIPE_SZ, capped at /proc/sys/fs/pipe-max-size
+	};
+
+	struct output_pipe
+	{
+		int read = -1;
+		int write = -1; // for spawn_template::output
+	};
+
+	/*
+	 * Collects the stdout and stderr of the workers through one pipe each.
+	 * A file per worker (a "{pid}" in the path) keeps the bytes in the kernel
+	 * (splice), so the file name is the only tag its lines get. A file shared
+	 * by the pool, and the logger target, have to read the bytes: every line
+	 * is prefixed with [pool:pid], and the lines of one read go to a shared
+	 * file in a single O_APPEND write, never mixed up with another worker's.
+	 */
+	class output_capture
+	{
+		struct stream;
+
+		logger_ptr m_log;
+		std::vector<std::unique_ptr<stream>> m_streams;
+
+		void close(size_t index);
+		bool forward(stream& s); // false, once the worker's end is closed
+	public:
+		explicit output_capture(const logger_ptr& log);
+		~output_capture();
+		output_capture(const output_capture&) = delete;
+		output_capture& operator=(const output_capture&) = delete;
+
+		// false for target::discard, or if there is no pipe to be had
+		bool open(const output_config& conf, output_pipe& pipe);
+
+		// after the spawn: the write end is closed and the read end starts to
+		// be pumped; a pid <= 0 means the spawn failed and drops the pipe
+		void attach(int pid, output_pipe& pipe, const output_config& conf, const std::string& tag);
+
+		// moves everything waiting in the pipes; sleeps up to timeout, if nothing is
+		void pump(std::chrono::milliseconds timeout);
+
+		// the read ends with the pid of their worker, for an event loop to wait
+		// on; pump() moves the bytes when one of them is readable
+		std::vector<std::pair<int, int>> streams() const;
+
+		// moves what is waiting in the read ends the event loop found readable,
+		// without a poll() of all the others
+		void pump(const std::vector<int>& ready);
+
+		size_t size() const { return m_streams.size(); }
+	};
+}
+
+#endif // __LIBREMOTE_CAPTURE_HPP__
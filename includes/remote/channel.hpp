@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_CHANNEL_HPP__
+#define __LIBREMOTE_CHANNEL_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace remote
+{
+	struct control_message
+	{
+		enum : uint32_t
+		{
+			command = 1,    // supervisor -> worker, see remote::command
+			heartbeat,      // worker -> supervisor
+			stats,          // worker -> supervisor, payload is up to the worker
+			user = 1024
+		};
+
+		static constexpr size_t payload_size = 48;
+
+		uint32_t type = 0;
+		uint32_t size = 0;  // of the payload actually used
+		uint8_t payload[payload_size];
+	};
+
+	/*
+	 * Control plane between the supervisor and one worker: a shared memory
+	 * file with two rings of fixed-size messages, commands going down to the
+	 * worker and heartbeats and stats coming back up. Sending and receiving
+	 * never enter the kernel; the eventfd of a ring is only written to, when
+	 * its reader went to sleep in wait().
+	 *
+	 * Each ring takes any number of senders, but only one receiver. The
+	 * supervisor creates the channel before the worker is spawned; the
+	 * worker attaches to it with inherit(), which reads the descriptors from
+	 * LIBREMOTE_CONTROL.
+	 */
+	class control_channel
+	{
+		struct ring;
+
+		int m_fd = -1;
+		int m_doorbells[2][2] = { { -1, -1 }, { -1, -1 } }; // read and write end for each ring
+		void* m_memory = nullptr;
+		size_t m_size = 0;
+		ring* m_rings[2] = { nullptr, nullptr };
+		uint32_t m_mask = 0;  // of the rings; never read back from the shared memory
+		uint64_t m_tail = 0;  // next position to receive from the inbox, ours only
+		bool m_worker = false;
+
+		ring* inbox() const { return m_rings[m_worker ? 0 : 1]; }
+		ring* outbox() const { return m_rings[m_worker ? 1 : 0]; }
+		int inbox_bell() const { return m_doorbells[m_worker ? 0 : 1][0]; }
+		int outbox_bell() const { return m_doorbells[m_worker ? 1 : 0][1]; }
+		bool map(size_t size);
+		void release();
+	public:
+		static constexpr const char* env_name = "LIBREMOTE_CONTROL";
+
+		control_channel() = default;
+		explicit control_channel(size_t capacity); // in messages per ring, rounded up to a power of 2
+		~control_channel();
+		control_channel(const control_channel&) = delete;
+		control_channel& operator=(const control_channel&) = delete;
+		control_channel(control_channel&& oth);
+		control_channel& operator=(control_channel&& oth);
+
+		static control_channel inherit();
+
+		explicit operator bool() const { return !!m_memory; }
+
+		// what the worker has to inherit: the descriptors and the LIBREMOTE_CONTROL=... entry
+		std::vector<int> fds() const;
+		std::string env() const;
+
+		// false, when the ring is full
+		bool send(const control_message& msg);
+		bool send(uint32_t type, const void* payload = nullptr, size_t size = 0);
+
+		// false, when there is nothing to receive; never blocks
+		bool receive(control_message& msg);
+
+		// blocks until there is something to receive, or the timeout passes
+		bool wait(std::chrono::milliseconds timeout);
+
+		// the worker stamps the channel from its event loop; a plain store to the
+		// shared memory, cheap enough to do on every iteration. The supervisor's
+		// watchdog compares last_beat() to its own clock (CLOCK_MONOTONIC on both sides)
+		void beat();
+		std::chrono::steady_clock::time_point last_beat() const;
+
+		// for an outside poll loop: arm() asks the other side to ring wake_fd() on
+		// the next send; false, if there is something to receive already. The
+		// supervisor watches wake_fd() of every worker in its backend's wait()
+		bool arm();
+		int wake_fd() const { return inbox_bell(); }
+	};
+}
+
+#endif // __LIBREMOTE_CHANNEL_HPP__
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_COMPRESSED_LOG_HPP__
+#define __LIBREMOTE_COMPRESSED_LOG_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace remote
+{
+	// the LZ4 block format: no dictionary, no frame, no checksum; what goes
+	// between two compressed_log frame headers
+	namespace lz4
+	{
+		inline size_t bound(size_t size) { return size + size / 255 + 16; }
+
+		// dst has to have room for bound(size); returns the compressed size
+		size_t compress(const void* src, size_t size, void* dst);
+
+		// false, unless src decompresses to exactly raw_size bytes
+		bool decompress(const void* src, size_t size, void* dst, size_t raw_size);
+	}
+
+	/*
+	 * Layout of a compressed log, in the byte order of the writer:
+	 *
+	 *   header: "LRLZ" | uint32 version
+	 *   frame:  "LZFR" | uint32 flags | uint32 raw size | uint32 stored size |
+	 *           uint32 checksum | uint32 0 | uint64 raw offset | int64 time | data
+	 *
+	 * Every frame is compressed on its own, so the log can be read from any
+	 * frame on. The frame headers are the index: walking them only needs the
+	 * stored sizes, raw offset is the position of the frame's first byte in
+	 * the text as a whole and time about the moment its first line was logged
+	 * (unix time in nanoseconds). A frame ends with a full line. The checksum is
+	 * FNV-1a of the text; flags tell whether the data is compressed at all.
+	 */
+	namespace compressed_log
+	{
+		enum : uint32_t
+		{
+			magic = 0x5a4c524c,       // "LRLZ"
+			frame_magic = 0x52465a4c, // "LZFR"
+			version = 1,
+			stored = 0,               // flags: the data is the text as it was
+			lz4_block = 1
+		};
+
+		struct frame
+		{
+			uint64_t offset = 0;      // of the frame header, in the file
+			uint64_t raw_offset = 0;
+			int64_t time = 0;
+			uint32_t flags = 0;
+			uint32_t raw_size = 0;
+			uint32_t stored_size = 0;
+			uint32_t checksum = 0;
+		};
+
+		class reader
+		{
+			FILE* m_file = nullptr;
+			uint64_t m_size = 0;
+			uint64_t m_next = 0;
+			bool m_valid = false;
+		public:
+			explicit reader(const std::string& path);
+			~reader();
+			reader(const reader&) = delete;
+			reader& operator=(const reader&) = delete;
+
+			explicit operator bool() const { return m_valid; }
+
+			// the next frame header, without reading the data; false at the
+			// end of the log, or at a frame which was cut short or is damaged
+			bool next(frame& out);
+
+			// decompresses any frame next() returned, in any order
+			bool read(const frame& info, std::string& text);
+		};
+	}
+
+	struct compressed_log_config
+	{
+		std::string path;
+		size_t frame_size = 1024 * 1024;                  // of text per frame, before compression
+		std::chrono::milliseconds flush_interval{ 1000 }; // a frame is cut at the latest then
+		size_t max_buffered = 16 * 1024 * 1024;           // above that, lines are dropped (and counted)
+		bool location = false;                            // "file:line: " after the time stamp
+	};
+
+	/*
+	 * Text lines, the same as file_logger writes, compressed a frame at a
+	 * time on a background thread. The calling thread only copies the line.
+	 * An existing log is continued; a frame which was cut short by a crash is
+	 * cut off before the first new one goes behind it. A frame which could
+	 * not be written whole is cut off right away, and the next frame notes the
+	 * lines lost with it; if it cannot be cut off, the logger closes rather
+	 * than put good frames behind a damaged one, which a reader stops at.
+	 */
+	class compressed_logger : public logger
+	{
+		compressed_log_config m_config;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_flushed;
+		using line_times = std::vector<std::pair<size_t, int64_t>>; // where each line starts, and when it was logged
+
+		std::string m_pending;
+		std::string m_spare;
+		line_times m_pending_times;
+		line_times m_spare_times;
+		uint64_t m_dropped = 0;
+		uint64_t m_lost = 0; // in frames which could not be written
+		int m_error = 0;     // errno of the last of them
+		uint64_t m_flush_done = 0;
+		uint64_t m_flush_request = 0;
+		bool m_stop = false;
+		std::thread m_thread;
+
+		std::atomic<int> m_fd{ -1 }; // closed by the writer thread, if a damaged frame cannot be cut off
+		uint64_t m_raw_offset = 0;
+		uint64_t m_end = 0;          // of the last whole frame in the file
+		std::string m_compressed;
+
+		bool open();
+		void run();
+		bool write_frame(const char* text, size_t size, int64_t time);
+	public:
+		explicit compressed_logger(const compressed_log_config& config);
+		~compressed_logger();
+		compressed_logger(const compressed_logger&) = delete;
+		compressed_logger& operator=(const compressed_logger&) = delete;
+
+		explicit operator bool() const { return m_fd >= 0; }
+
+		void write(const char* path, int line, std::string_view text) override;
+
+		// cuts a frame out of what is waiting and waits until it is written
+		void flush();
+	};
+}
+
+#endif // __LIBREMOTE_COMPRESSED_LOG_HPP__
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef __LIBREMOTE_EVENT_LOOP_HPP__
+#define __LIBREMOTE_EVENT_LOOP_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "signals.hpp"
+
+namespace remote
+{
+	/*
+	 * Everything the supervisor waits for, waited for at once: the exits of
+	 * the workers, descriptors becoming readable (the output pipes, the
+	 * doorbells of the control channels) and the timeout of the tick. The
+	 * io_uring backend queues all of it in one ring, so an iteration is a
+	 * single io_uring_enter() no matter how many workers there are; the
+	 * epoll backend (with a pidfd per worker) is the fallback for the
+	 * kernels which have no io_uring, or have it switched off.
+	 *
+	 * write() and watch_signals() are there for the owners of a loop which
+	 * want them; the supervisor does not use either, its log goes through the
+	 * logger it was given (file_logger has a writer thread of its own) and
+	 * its signals through remote::signals.
+	 *
+	 * Not thread-safe, apart from wake(); the callbacks run inside
+	 * run_once(), on its thread.
+	 */
+	class event_loop
+	{
+	public:
+		enum class kind
+		{
+			automatic, // io_uring where the kernel lets us, epoll otherwise
+			io_uring,
+			epoll
+		};
+
+		struct counters
+		{
+			uint64_t syscalls = 0;   // made by the loop itself, the callbacks not counted
+			uint64_t events = 0;     // callbacks run
+			uint64_t iterations = 0; // calls of run_once()
+		};
+
+		// status as os::reap() reports it: the exit code, or 128 + the signal;
+		// unknown_status, if somebody else reaped the child (ECHILD)
+		using child_fn = std::function<void(int pid, int status)>;
+		static constexpr int unknown_status = -1;
+		using ready_fn = std::function<void()>;
+		// the bytes read; size 0 at the end of the file, after which the descriptor is not read any more
+		using read_fn = std::function<void(const char* data, size_t size)>;
+
+		// nullptr, if the kind asked for is not available (or nothing is, as on Windows)
+		static std::unique_ptr<event_loop> create(kind which = kind::automatic);
+		virtual ~event_loop();
+
+		virtual const char* name() const = 0;
+
+		// reaps the child when it exits, which nothing else may do then;
+		// false, if it cannot be watched, so the caller has to reap it
+		virtual bool watch_child(int pid, const child_fn& fn) = 0;
+
+		// fn is called every time fd is readable, until unwatch(); it has to
+		// read, or it is called right again
+		virtual bool watch(int fd, const ready_fn& fn) = 0;
+
+		// the loop reads, up to size bytes at a time, and hands the bytes to fn
+		virtual bool watch_read(int fd, size_t size, const read_fn& fn) = 0;
+
+		virtual void unwatch(int fd) = 0;
+
+		// in the background, the writes to one descriptor in the order they were
+		// made; the descriptor has to stay open until they are done
+		virtual void write(int fd, std::string data) = 0;
+
+		// the signals come through a signalfd; they have to be blocked in every
+		// thread of the process, or they are delivered the usual way instead
+		bool watch_signals(const std::vector<int>& sigs, const signal_info_t& fn);
+
+		// ends the current (or the next) run_once(); from any thread
+		virtual void wake() = 0;
+
+		// waits up to timeout for anything to happen and runs the callbacks;
+		// the number of them, 0 after the timeout
+		virtual size_t run_once(std::chrono::milliseconds timeout) = 0;
+
+		// true until all the writes are done
+		virtual bool writing() const = 0;
+
+		const counters& stats() const { return m_counters; }
+	protected:
+		counters m_counters;
+		std::vector<int> m_owned; // closed by the destructor, e.g. the signalfds
+	};
+	using event_loop_ptr = std::unique_ptr<event_loop>;
+}
+
+#endif // __LIBREMOTE_EVENT_LOOP_HPP__
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_FILE_LOGGER_HPP__
+#define __LIBREMOTE_FILE_LOGGER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.hpp"
+#include "signals.hpp"
+
+namespace remote
+{
+	struct file_log_config
+	{
+		std::string path;
+		size_t rotate_size = 0;                         // 0 never rotates
+		unsigned keep = 5;                              // rotated files kept: path.1 (newest) .. path.keep
+		size_t batch_size = 256 * 1024;                 // written out as soon as that much is waiting
+		std::chrono::milliseconds flush_interval{ 200 }; // ... or that much time passed
+		size_t max_buffered = 16 * 1024 * 1024;         // above that, lines are dropped (and counted)
+		bool location = false;                          // "file:line: " after the time stamp
+	};
+
+	/*
+	 * Lines are appended to 64k chunks in memory; a writer thread takes all
+	 * the chunks waiting and hands them to a single writev() on an O_APPEND
+	 * descriptor. Rotating and reopening happen on the writer thread too, so
+	 * a thread which logs only ever waits for a memcpy.
+	 */
+	class file_logger : public logger
+	{
+		using chunk = std::string;
+
+		file_log_config m_config;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_flushed;
+		std::vector<chunk> m_pending;
+		std::vector<chunk> m_spare;
+		size_t m_buffered = 0;
+		uint64_t m_dropped = 0;
+		uint64_t m_lost = 0;  // written out, but refused by the file
+		int m_error = 0;      // errno of the last refusal
+		uint64_t m_flush_done = 0;
+		uint64_t m_flush_request = 0;
+		bool m_stop = false;
+		std::atomic<bool> m_reopen{ false };
+		std::thread m_thread;
+
+		std::atomic<int> m_fd{ -1 }; // replaced by rotate() and reopen() on the writer thread
+		size_t m_size = 0;
+
+		signals* m_signals = nullptr;
+		signal_token m_token = 0;
+
+		void append(std::string_view text);
+		void run();
+		bool open();
+		void rotate();
+		size_t write_out(std::vector<chunk>& chunks); // the lines which could not be written
+	public:
+		explicit file_logger(const file_log_config& config);
+		~file_logger();
+		file_logger(const file_logger&) = delete;
+		file_logger& operator=(const file_logger&) = delete;
+
+		explicit operator bool() const { return m_fd >= 0; }
+
+		void write(const char* path, int line, std::string_view text) override;
+
+		// the file is closed and opened again, when the signal comes (e.g.
+		// after logrotate moved it away); the signals have to outlive the logger
+		bool reopen_on(signals& sig, const char* name);
+		void reopen();
+
+		// waits until everything logged so far is written out
+		void flush();
+	};
+}
+
+#endif // __LIBREMOTE_FILE_LOGGER_HPP__
@@ -25,6 +25,8 @@
 #ifndef __LIBREMOTE_IDENTITY_HPP__
 #define __LIBREMOTE_IDENTITY_HPP__
 
+#include <vector>
+
 namespace remote
 {
 	enum class identity
@@ -36,7 +38,21 @@ namespace remote
 		oom
 	};
 
+	struct credentials
+	{
+		unsigned int uid = 0;
+		unsigned int gid = 0;
+		std::vector<unsigned int> groups; // supplementary groups, including gid
+	};
+
+	// looks the user (and the optional group overriding the user's primary group)
+	// up once; later calls for the same pair are answered from a process-wide cache,
+	// which keeps only the pairs resolved successfully
+	identity resolve_identity(const char* uname, const char* gname, credentials& out);
+	void forget_identities();
+
 	identity change_identity(const char* uname, const char* gname);
+	identity change_identity(const credentials& creds);
 }
 
 #endif // __LIBREMOTE_LOGGER_HPP__
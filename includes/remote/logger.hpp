@@ -25,7 +25,16 @@
 #ifndef __LIBREMOTE_LOGGER_HPP__
 #define __LIBREMOTE_LOGGER_HPP__
 
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <stdarg.h>
 
 namespace remote
@@ -38,31 +47,411 @@ namespace remote
 
 	using stream_logger_ptr = std::shared_ptr<stream_logger>;
 
+	// one per LOG() call site, constant-initialised, so it costs nothing until
+	// the first line; a binary logger numbers it then and describes it once
+	struct log_site
+	{
+		const char* file;
+		int line;
+		mutable std::atomic<uint32_t> id{ 0 };
+
+		constexpr log_site(const char* file, int line) : file(file), line(line) {}
+	};
+
+	/*
+	 * State of a LOG_LIMIT() or LOG_SAMPLE() call site. The rate limit is a
+	 * token bucket kept as one timestamp (GCRA): a line passes, unless it
+	 * would come sooner than the bucket refills. What is held back is counted;
+	 * the next line to pass reports the count, and so does log_suppressed()
+	 * for the sites which went quiet since.
+	 */
+	struct log_limit
+	{
+		log_site site;
+		std::atomic<int64_t> tat{ 0 };         // steady_clock, in nanoseconds
+		std::atomic<uint64_t> suppressed{ 0 };
+		std::atomic<bool> listed{ false };
+		log_limit* next = nullptr;             // in the list of sites which suppressed a line
+
+		constexpr log_limit(const char* file, int line) : site(file, line) {}
+
+		bool pass(double per_second, unsigned burst);
+		bool sample(unsigned one_in);
+	};
+
+	struct log_rate
+	{
+		double per_second;
+		unsigned burst;
+	};
+
+	struct log_sample
+	{
+		unsigned one_in;
+	};
+
+	class log_gate
+	{
+		log_limit* m_limit;
+		uint64_t m_suppressed = 0;
+		bool m_open;
+
+		void opened()
+		{
+			if (m_open && m_limit->suppressed.load(std::memory_order_relaxed))
+				m_suppressed = m_limit->suppressed.exchange(0, std::memory_order_relaxed);
+		}
+	public:
+		log_gate(log_limit& limit, log_rate rate) : m_limit(&limit), m_open(limit.pass(rate.per_second, rate.burst)) { opened(); }
+		log_gate(log_limit& limit, log_sample sample) : m_limit(&limit), m_open(limit.sample(sample.one_in)) { opened(); }
+
+		explicit operator bool() const { return m_open; }
+		void done() { m_open = false; }
+		const log_site& site() const { return m_limit->site; }
+		uint64_t suppressed() const { return m_suppressed; }
+	};
+
+	/*
+	 * The arguments of a binary line: a tag, then the raw bytes, in the
+	 * byte order of the writer.
+	 *
+	 *   'i' int64, 'u' uint64, 'd' double, 'c' char, 'b' bool (one byte)
+	 *   's' uint32 length + the bytes, also used for anything formatted at the call site
+	 */
+	namespace log_arg
+	{
+		enum : char
+		{
+			i64 = 'i',
+			u64 = 'u',
+			f64 = 'd',
+			chr = 'c',
+			boolean = 'b',
+			str = 's'
+		};
+
+		// turns the arguments back into the text line_logger would have built
+		bool decode(std::string_view args, std::string& out);
+	}
+
 	struct logger
 	{
+		// set by the loggers which take write(const log_site&, ...); read once per line
+		bool binary = false;
+
 		virtual ~logger() {}
-		virtual stream_logger_ptr line(const char* path, int line) = 0;
+
+		// the older contract, one stream per line; still used by the default write()
+		virtual stream_logger_ptr line(const char*, int) { return nullptr; }
+
+		// one complete line, valid only for the time of the call; loggers written
+		// against this override it and leave line() alone
+		virtual void write(const char* path, int line, std::string_view text)
+		{
+			auto out = this->line(path, line);
+			if (out)
+				out->out() << text;
+		}
+
+		// the arguments of a line, see log_arg; formatting is left to the reader
+		virtual void write(const log_site& site, std::string_view args)
+		{
+			std::string text;
+			if (log_arg::decode(args, text))
+				write(site.file, site.line, text);
+		}
 	};
 
 	using logger_ptr = std::shared_ptr<logger>;
 
+	// logs the counts held back by LOG_LIMIT() and LOG_SAMPLE() since the last
+	// line of each site; meant to be called every few seconds
+	void log_suppressed(const logger_ptr& log);
+
+	// "2026-01-31 12:34:56.789 " in local time, for the sinks which write text;
+	// out needs room for the 24 characters, there is no terminating zero
+	size_t log_time_stamp(char* out);
+
+	namespace detail
+	{
+		class line_buffer : public std::streambuf
+		{
+		public:
+			std::string text;
+			std::string* target = &text;
+
+		protected:
+			int_type overflow(int_type c) override
+			{
+				if (!traits_type::eq_int_type(c, traits_type::eof()))
+					target->push_back(traits_type::to_char_type(c));
+				return traits_type::not_eof(c);
+			}
+
+			std::streamsize xsputn(const char* s, std::streamsize n) override
+			{
+				target->append(s, (size_t)n);
+				return n;
+			}
+		};
+
+		// a line being built; the one per thread is reused, so after the first
+		// few lines there is nothing left to allocate
+		struct line_state
+		{
+			line_buffer buffer;
+			std::ostream stream{ &buffer };
+			std::string scratch;    // a binary line's argument, formatted by the stream
+			bool busy = false;
+			bool formatted = false; // the stream was used, so the manipulators may have changed it
+
+			line_state() { buffer.text.reserve(1024); }
+
+			void reset()
+			{
+				buffer.text.clear();
+				busy = false;
+				if (formatted)
+				{
+					stream.flags(std::ios_base::dec | std::ios_base::skipws);
+					stream.width(0);
+					stream.precision(6);
+					stream.fill(' ');
+					stream.clear();
+					formatted = false;
+				}
+			}
+		};
+
+		inline line_state& thread_line()
+		{
+			static thread_local line_state state;
+			return state;
+		}
+
+		template <typename T>
+		constexpr bool is_number = std::is_integral<T>::value
+			&& !std::is_same<T, bool>::value
+			&& !std::is_same<T, char>::value
+			&& !std::is_same<T, signed char>::value
+			&& !std::is_same<T, unsigned char>::value
+			&& !std::is_same<T, wchar_t>::value
+			&& !std::is_same<T, char16_t>::value
+			&& !std::is_same<T, char32_t>::value;
+	}
+
+	/*
+	 * Builds the line in a thread-local buffer: strings and integers are
+	 * appended directly, anything else (and everything after a manipulator)
+	 * goes through an ostream kept with the buffer. The backend gets the
+	 * finished line with one call to logger::write.
+	 *
+	 * For a binary logger, the buffer gets the raw arguments instead of the
+	 * text (see log_arg); only what has to go through the ostream is
+	 * formatted at the call site.
+	 */
 	class line_logger
 	{
-		stream_logger_ptr m_line;
+		logger* m_logger;
+		const log_site* m_site = nullptr;
+		const char* m_path;
+		int m_line;
+		bool m_binary = false;
+		detail::line_state* m_state = nullptr;
+		std::unique_ptr<detail::line_state> m_own; // a line started while the thread's one is still open
+
+		void start()
+		{
+			if (!m_logger)
+				return;
+
+			m_binary = m_site && m_logger->binary;
+			m_state = &detail::thread_line();
+			if (m_state->busy)
+			{
+				m_own.reset(new detail::line_state);
+				m_state = m_own.get();
+			}
+			m_state->busy = true;
+		}
+
+		template <typename T>
+		void put(char tag, const T& value)
+		{
+			auto& text = m_state->buffer.text;
+			text.push_back(tag);
+			text.append((const char*)&value, sizeof(value));
+		}
+
+		void put(std::string_view value)
+		{
+			put(log_arg::str, (uint32_t)value.size());
+			m_state->buffer.text.append(value.data(), value.size());
+		}
+
+		template <typename T>
+		void format(const T& value)
+		{
+			m_state->formatted = true;
+			if (!m_binary)
+			{
+				m_state->stream << value;
+				return;
+			}
+
+			auto& scratch = m_state->scratch;
+			scratch.clear();
+			m_state->buffer.target = &scratch;
+			m_state->stream << value;
+			m_state->buffer.target = &m_state->buffer.text;
+			// a manipulator, which only changed the stream, leaves nothing to put
+			if (!scratch.empty())
+				put(scratch);
+		}
 	public:
-		line_logger(const logger_ptr& logger, const char* path, int line) : m_line(logger->line(path, line))
+		line_logger(const logger_ptr& logger, const char* path, int line)
+			: m_logger(logger.get())
+			, m_path(path)
+			, m_line(line)
+		{
+			start();
+		}
+
+		line_logger(const logger_ptr& logger, const log_site& site)
+			: m_logger(logger.get())
+			, m_site(&site)
+			, m_path(site.file)
+			, m_line(site.line)
+		{
+			start();
+		}
+
+		~line_logger()
 		{
+			if (!m_state)
+				return;
+
+			if (m_binary)
+				m_logger->write(*m_site, m_state->buffer.text);
+			else
+				m_logger->write(m_path, m_line, m_state->buffer.text);
+			m_state->reset();
 		}
 
+		line_logger(const line_logger&) = delete;
+		line_logger& operator = (const line_logger&) = delete;
+
 		template <typename T>
 		line_logger& operator << (const T& t)
 		{
-			m_line->out() << t;
+			if (!m_state)
+				return *this;
+
+			if (!m_state->formatted)
+			{
+				if constexpr (detail::is_number<T>)
+				{
+					if (m_binary)
+					{
+						if constexpr (std::is_signed<T>::value)
+							put(log_arg::i64, (int64_t)t);
+						else
+							put(log_arg::u64, (uint64_t)t);
+					}
+					else
+					{
+						char buffer[24];
+						auto ret = std::to_chars(buffer, buffer + sizeof(buffer), t);
+						m_state->buffer.text.append(buffer, ret.ptr);
+					}
+					return *this;
+				}
+				else if constexpr (std::is_same<T, char>::value)
+				{
+					if (m_binary)
+						put(log_arg::chr, t);
+					else
+						m_state->buffer.text.push_back(t);
+					return *this;
+				}
+				else if constexpr (std::is_same<T, bool>::value)
+				{
+					if (m_binary)
+						put(log_arg::boolean, (char)t);
+					else
+						m_state->buffer.text.push_back(t ? '1' : '0');
+					return *this;
+				}
+				else if constexpr (std::is_floating_point<T>::value)
+				{
+					if (m_binary)
+					{
+						put(log_arg::f64, (double)t);
+						return *this;
+					}
+				}
+				else if constexpr (std::is_convertible<const T&, std::string_view>::value)
+				{
+					std::string_view text{ "(null)" };
+					if constexpr (std::is_pointer<T>::value)
+					{
+						if (t)
+							text = t;
+					}
+					else
+						text = t;
+
+					if (m_binary)
+						put(text);
+					else
+						m_state->buffer.text.append(text.data(), text.size());
+					return *this;
+				}
+			}
+
+			format(t);
+			return *this;
+		}
+
+		line_logger& operator << (const log_gate& gate)
+		{
+			if (gate.suppressed())
+				*this << '(' << gate.suppressed() << " similar lines suppressed) ";
+			return *this;
+		}
+
+		// std::endl and the like may write, too; in a binary line that has to be an argument
+		line_logger& operator << (std::ostream& (*manip)(std::ostream&))
+		{
+			if (m_state)
+				format(manip);
+			return *this;
+		}
+
+		line_logger& operator << (std::ios_base& (*manip)(std::ios_base&))
+		{
+			if (m_state)
+				format(manip);
 			return *this;
 		}
 	};
 }
 
-#define LOG(logger) remote::line_logger{ logger, __FILE__, __LINE__ }
+#define LOG_AT(logger, site) remote::line_logger{ logger, site }
+#define LOG(logger) remote::line_logger{ logger, []() -> const remote::log_site& { static remote::log_site site{ __FILE__, __LINE__ }; return site; }() }
+
+#define REMOTE_LOG_GATED_ON(logger, limit, policy) \
+	for (remote::log_gate remote_log_gate{ limit, policy }; remote_log_gate; remote_log_gate.done()) \
+		LOG_AT(logger, remote_log_gate.site()) << remote_log_gate
+#define REMOTE_LOG_GATED(logger, policy) \
+	REMOTE_LOG_GATED_ON(logger, ([]() -> remote::log_limit& { static remote::log_limit limit{ __FILE__, __LINE__ }; return limit; }()), policy)
+
+// at most per_second lines on average, with bursts of up to burst lines
+#define LOG_LIMIT(logger, per_second, burst) REMOTE_LOG_GATED(logger, (remote::log_rate{ (double)(per_second), (unsigned)(burst) }))
+// the same with a log_limit of the caller's, e.g. one per pool instead of one
+// per call site; log_suppressed() keeps it, so it has to outlive the process
+#define LOG_LIMIT_ON(logger, limit, per_second, burst) REMOTE_LOG_GATED_ON(logger, limit, (remote::log_rate{ (double)(per_second), (unsigned)(burst) }))
+// every one_in-th line, picked at random
+#define LOG_SAMPLE(logger, one_in) REMOTE_LOG_GATED(logger, (remote::log_sample{ (unsigned)(one_in) }))
 
 #endif // __LIBREMOTE_LOGGER_HPP__
@@ -32,11 +32,18 @@ namespace remote
 	class pid
 	{
 		std::string m_path;
+		int m_fd = -1; // locked for as long as the object lives
 	public:
 		pid(const std::string& path);
 		~pid();
+		pid(const pid&) = delete;
+		pid& operator=(const pid&) = delete;
 
 		static bool read(const std::string& path, int& _pid);
+
+		// true, if the process which wrote the file still holds its lock;
+		// a file left behind by a crash is not locked anymore
+		static bool is_running(const std::string& path);
 	};
 }
 
@@ -25,15 +25,54 @@
 #ifndef __LIBREMOTE_RESPAWN_HPP__
 #define __LIBREMOTE_RESPAWN_HPP__
 
+#include <chrono>
+#include <map>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 
+#include "accept.hpp"
+#include "channel.hpp"
+#include "identity.hpp"
 #include "logger.hpp"
+#include "trace.hpp"
 
 namespace remote
 {
+	struct spawn_pacing
+	{
+		size_t concurrency = 16;                       // workers launched together, in one batch
+		std::chrono::milliseconds ramp{ 0 };           // pause between the batches
+		std::chrono::milliseconds ready_timeout{ 5000 }; // how long a batch waits for its workers to exec
+	};
+
+	struct spawn_batch
+	{
+		size_t started = 0;
+		size_t ready = 0;
+		size_t failed = 0;
+		std::chrono::steady_clock::duration elapsed{};
+	};
+
+	struct spawn_report
+	{
+		std::vector<int> pids;      // the workers running
+		std::vector<int> timed_out; // missed ready_timeout, killed and reaped
+		std::vector<spawn_batch> batches;
+	};
+
+	struct spawn_template
+	{
+		std::vector<std::string> args;
+		std::vector<std::string> env;   // NAME=value entries added on top of the inherited environment
+		std::vector<int> inherit;       // descriptors which stay open in the worker
+		std::shared_ptr<const credentials> identity; // applied in the worker, empty to keep the spawner's
+		std::map<std::string, unsigned long long> limits; // "nofile", "core", "nproc", ...
+		int process_group = -1;         // -1 keeps the spawner's, 0 starts a new one, >0 joins it
+		int output = -1;                // stdout and stderr of the worker, /dev/null if -1; POSIX only
+	};
+
 	namespace os
 	{
 		struct socklib
@@ -43,7 +82,26 @@ namespace remote
 		};
 
 		void close(int socket);
-		int fcgi(int stdIn, const std::vector<std::string>& args);
+		bool connect_probe(int socket, const void* addr, int addrlen, std::chrono::milliseconds timeout);
+		// true, if a listener of another process is on the port the socket is bound to;
+		// false where that cannot be told (no /proc/net/tcp, Windows)
+		bool foreign_listener(int socket);
+		int fcgi(int stdIn, const spawn_template& tmpl, trace* tracer = nullptr, int lane = 0);
+		int fcgi_batch(int stdIn, const spawn_template& tmpl, size_t count, const spawn_pacing& pacing, spawn_report& report, trace* tracer = nullptr);
+
+		// supervisor primitives; spawn returns the pid of the worker, or -1,
+		// reap returns the pid of a worker which exited, or 0, without waiting;
+		// the status is the exit code, or 128 + signal number; when the worker
+		// could not exec, fcgi and spawn leave errno at the reason
+		int spawn(int stdIn, const spawn_template& tmpl, trace* tracer = nullptr, int lane = 0);
+		int reap(int& status);
+		int reap(int pid, int& status); // only that worker, e.g. next to an event_loop which owns the others
+		bool terminate(int pid, bool force);
+		int process_group(int pid);
+		bool limit_known(const std::string& name);
+
+		// the file the workers append their output to; -1 on error or where not supported
+		int open_output(const std::string& path);
 	}
 
 	class spawn_error : public std::runtime_error
@@ -60,7 +118,32 @@ namespace remote
 
 	struct respawn
 	{
+		enum class probe
+		{
+			connect,   // non-blocking connect bounded by probe_timeout
+			bind,      // no probe, bind() reports EADDRINUSE
+			reuseport  // no probe, SO_REUSEPORT; the port may be shared with this process's own
+			           // listeners only, one of another process counts as the port being used
+		};
+
+		struct options
+		{
+			trace_ptr trace; // if set, receives a span for every startup phase
+			probe address_probe = probe::connect;
+			std::chrono::milliseconds probe_timeout{ 250 };
+			std::shared_ptr<accept_mutex> accept; // if set, handed down to the workers, see accept_mutex::inherit
+			std::shared_ptr<const credentials> identity; // see resolve_identity; the spawner keeps its own
+			std::shared_ptr<control_channel> control; // if set, handed down to the worker; fcgi only, a pool would share it
+			std::string output; // the workers append their stdout and stderr there, instead of /dev/null
+		};
+
 		static int fcgi(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args);
+		static int fcgi(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args, const options& opts);
+		// opens the listener respawn::fcgi would hand to the workers; throws spawn_error
+		static int listen(const std::string& address, const options& opts);
+
+		static int fcgi_pool(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args, size_t workers, const spawn_pacing& pacing, spawn_report& report);
+		static int fcgi_pool(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args, size_t workers, const spawn_pacing& pacing, spawn_report& report, const options& opts);
 	};
 }
 
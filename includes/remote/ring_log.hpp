@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_RING_LOG_HPP__
+#define __LIBREMOTE_RING_LOG_HPP__
+
+#include <cstdint>
+#include <string>
+
+#include "logger.hpp"
+
+namespace remote
+{
+	/*
+	 * Flight recorder: the log lines go to a file mapped into memory and
+	 * used as a ring, so writing a line is a reservation and a memcpy, with
+	 * no system call. The pages belong to the kernel's page cache, so what
+	 * was written before the process crashed (or got SIGKILLed) is still in
+	 * the file afterwards; only a crash of the machine itself loses it.
+	 *
+	 * Layout, in the byte order of the writer:
+	 *
+	 *   header (4k): "LRRB" | uint32 version | uint64 capacity | uint64 head | int32 pid
+	 *   ring (capacity bytes, a power of 2) of records aligned to 16 bytes:
+	 *     uint64 position | uint32 size | uint32 state | int64 time |
+	 *     uint32 line | uint16 file length | uint16 0 | uint32 text length | file | text
+	 *
+	 * head counts all the bytes ever reserved; a record's position is the
+	 * value head had when the record was reserved, which lets a reader tell
+	 * the records still in the ring from the overwritten ones. A record never
+	 * wraps: the end of the ring is filled with a padding record instead.
+	 */
+	namespace ring_log
+	{
+		enum : uint32_t
+		{
+			magic = 0x4252524c, // "LRRB"
+			version = 1
+		};
+
+		struct entry
+		{
+			int64_t time = 0;
+			std::string file;
+			int line = 0;
+			std::string text;
+		};
+
+		class reader
+		{
+			std::string m_ring;
+			uint64_t m_head = 0;
+			uint64_t m_next = 0;
+			int m_pid = 0;
+			unsigned m_lost = 0;
+			bool m_synced = false;
+			bool m_valid = false;
+		public:
+			explicit reader(const std::string& path);
+
+			explicit operator bool() const { return m_valid; }
+			int pid() const { return m_pid; } // of the last process which opened the ring
+
+			// oldest first; false after the newest line
+			bool next(entry& out);
+
+			// records skipped so far, because they were being written (or
+			// overwritten) when the ring was read or the writer died
+			unsigned lost() const { return m_lost; }
+		};
+	}
+
+	class ring_logger : public logger
+	{
+		int m_fd = -1;
+		char* m_memory = nullptr;
+		size_t m_size = 0;
+		uint64_t m_capacity = 0;
+
+		char* ring() const { return m_memory + 4096; }
+		bool map(const std::string& path, uint64_t capacity);
+		void release();
+	public:
+		// capacity is rounded up to a power of 2, at least 64k; a ring left
+		// by a previous process with the same capacity is continued, not cleared.
+		// Any other file at path is replaced, never truncated: a process which
+		// still has it mapped keeps writing to the old one
+		ring_logger(const std::string& path, size_t capacity);
+		~ring_logger();
+		ring_logger(const ring_logger&) = delete;
+		ring_logger& operator=(const ring_logger&) = delete;
+
+		explicit operator bool() const { return !!m_memory; }
+
+		void write(const char* path, int line, std::string_view text) override;
+	};
+}
+
+#endif // __LIBREMOTE_RING_LOG_HPP__
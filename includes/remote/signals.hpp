@@ -27,12 +27,35 @@
 
 #include <memory>
 #include <functional>
+#include <vector>
 #include "logger.hpp"
 
 namespace remote
 {
 	using signal_t = std::function<void()>;
 
+	struct signal_info
+	{
+		int signal = 0;
+		int sender = 0;      // pid of the sender, 0 if not known
+		int value = 0;       // the payload of queue()
+		bool queued = false; // the signal came from queue() and carries a value
+	};
+	using signal_info_t = std::function<void(const signal_info&)>;
+
+	// the commands sent through signals::command(); the argument has 24 bits
+	enum class command : unsigned char
+	{
+		drain = 1,
+		dump_stats,
+		log_level,
+		user = 128
+	};
+	using command_t = std::function<void(command cmd, unsigned arg, int sender)>;
+
+	// identifies one subscription; later subscriptions get larger tokens, 0 is never given out
+	using signal_token = unsigned long long;
+
 	namespace os
 	{
 		struct signals;
@@ -40,10 +63,26 @@ namespace remote
 		struct signals
 		{
 			static signals_ptr create(const logger_ptr& log);
+			// whether sig names a signal this platform can send, as remote::signals takes it
+			static bool known(const char* sig);
 			virtual ~signals() {}
 			virtual bool set(const char* sig, const signal_t& fn) = 0;
+			virtual bool set(const char* sig, const signal_info_t& fn) = 0;
+			virtual signal_token subscribe(const char* sig, const signal_t& fn) = 0;
+			virtual signal_token subscribe(const char* sig, const signal_info_t& fn) = 0;
+			virtual bool unsubscribe(signal_token token) = 0;
 			virtual bool signal(const char* sig, int pid) = 0;
+			virtual bool signal_group(const char* sig, int pgid) = 0;
+			virtual std::vector<bool> signal(const char* sig, const std::vector<int>& pids) = 0;
+			virtual bool queue(const char* sig, int pid, int value) = 0;
+			virtual std::vector<bool> queue(const char* sig, const std::vector<int>& pids, int value) = 0;
 			virtual void cleanup() {}
+
+			// a child of this process, from its spawn until it is reaped: signal()
+			// goes through a handle kept all that time (a pidfd, on Linux), never
+			// to a process which took its pid over; see os::backend::spawn
+			virtual void spawned(int) {}
+			virtual void reaped(int) {}
 		};
 	}
 
@@ -52,9 +91,39 @@ namespace remote
 		os::signals_ptr os_sig;
 	public:
 		explicit signals(const logger_ptr& log) : os_sig{ os::signals::create(log) } {}
+		explicit signals(const os::signals_ptr& sig) : os_sig{ sig } {} // e.g. from an os::backend
 		~signals() { os_sig->cleanup(); }
+		// signal names are "stop", "reload", "child", the POSIX names ("SIGUSR1" or "usr1")
+		// and the realtime ones ("SIGRTMIN+3" or "rt3"); handlers run on a separate thread.
+		// SIGKILL, SIGSTOP and the faults (SIGSEGV, SIGBUS, SIGFPE, SIGILL) are refused
 		bool set(const char* sig, const signal_t& fn) { return os_sig->set(sig, fn); }
+		bool set(const char* sig, const signal_info_t& fn) { return os_sig->set(sig, fn); }
+
+		// adds to the handlers already there, instead of replacing the one from set();
+		// the handlers of a signal are called in the order they subscribed
+		signal_token subscribe(const char* sig, const signal_t& fn) { return os_sig->subscribe(sig, fn); }
+		signal_token subscribe(const char* sig, const signal_info_t& fn) { return os_sig->subscribe(sig, fn); }
+		// waits for the handler, if it is being called right now
+		bool unsubscribe(signal_token token) { return os_sig->unsubscribe(token); }
+
 		bool signal(const char* sig, int pid) { return os_sig->signal(sig, pid); }
+
+		// one kill() for the whole process group of a pool
+		bool signal_group(const char* sig, int pgid) { return os_sig->signal_group(sig, pgid); }
+
+		// a selected subset; the result tells, which of the pids got the signal
+		std::vector<bool> signal(const char* sig, const std::vector<int>& pids) { return os_sig->signal(sig, pids); }
+
+		// sigqueue(): realtime signals sent this way are queued, not merged, and carry
+		// the value to signal_info::value; false, where the platform cannot do that
+		bool queue(const char* sig, int pid, int value) { return os_sig->queue(sig, pid, value); }
+		std::vector<bool> queue(const char* sig, const std::vector<int>& pids, int value) { return os_sig->queue(sig, pids, value); }
+
+		// commands are queued on the "command" realtime signal (SIGRTMIN),
+		// one per call, in the order they were sent
+		signal_token on_command(const command_t& fn);
+		bool command(int pid, remote::command cmd, unsigned arg = 0);
+		std::vector<bool> command(const std::vector<int>& pids, remote::command cmd, unsigned arg = 0);
 	};
 }
 
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_SIMULATION_HPP__
+#define __LIBREMOTE_SIMULATION_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "backend.hpp"
+
+namespace remote
+{
+	struct simulation_config
+	{
+		uint64_t seed = 1;                                // same seed, same run
+		std::chrono::microseconds spawn_time{ 0 };        // virtual time one spawn takes
+		double spawn_failure = 0;                         // chance of a spawn to fail
+		std::chrono::milliseconds mean_lifetime{ 0 };     // workers exit with status 1 after a random (exponential) lifetime; 0 for never
+		std::chrono::milliseconds term_delay{ 20 };       // between SIGTERM and the exit
+		double ignore_term = 0;                           // chance of a worker to ignore SIGTERM, so only SIGKILL stops it
+	};
+
+	/*
+	 * An os::backend without an operating system: the workers are entries in
+	 * a table with made up pids, their exits are events in a queue, and time
+	 * only moves when the supervisor waits for its next tick (or a spawn
+	 * takes spawn_time). Given the same seed and script, every run makes the
+	 * same calls in the same order, whatever the machine.
+	 *
+	 * The script runs actions at points of virtual time, on the thread of
+	 * supervisor::run(), from within wait(): crash some workers, raise
+	 * "reload" after rewriting the config, raise "stop" to end the run.
+	 */
+	class simulation : public os::backend
+	{
+	public:
+		struct counters
+		{
+			uint64_t spawned = 0;
+			uint64_t spawn_failed = 0;
+			uint64_t exited = 0;
+			uint64_t reaped = 0;
+			uint64_t terminated = 0;  // SIGTERMs which reached a worker
+			uint64_t killed = 0;      // SIGKILLs, the same
+			uint64_t signals = 0;     // everything sent through create_signals()
+			uint64_t ticks = 0;
+		};
+
+		using action = std::function<void(simulation&)>;
+
+	private:
+		struct process
+		{
+			int group = 0;
+			bool ignores_term = false;
+			bool exited = false;
+		};
+
+		struct event
+		{
+			clock::time_point time;
+			uint64_t order;
+			int pid;
+			int status;
+
+			bool operator<(const event& rhs) const
+			{
+				// std::priority_queue keeps the largest on top
+				return time != rhs.time ? time > rhs.time : order > rhs.order;
+			}
+		};
+
+		struct handlers;
+
+		simulation_config m_config;
+		std::mt19937_64 m_random;
+		clock::time_point m_start;
+		clock::time_point m_now;
+		int m_next_pid = 2;
+		int m_next_socket = 1000;
+		uint64_t m_next_event = 0;
+		std::unordered_map<int, process> m_processes;
+		std::priority_queue<event> m_events;
+		std::deque<std::pair<int, int>> m_exited; // pid and status, waiting for reap()
+		std::multimap<clock::time_point, action> m_script;
+		std::shared_ptr<handlers> m_handlers;
+		counters m_counters;
+		std::chrono::steady_clock::time_point m_woke{}; // real time wait() last returned
+
+		bool chance(double p);
+		void exit_at(int pid, clock::time_point when, int status);
+		void deliver(const char* sig, int pid, bool& found);
+		void run_events();
+	public:
+		explicit simulation(const simulation_config& config = {});
+		~simulation();
+
+		// os::backend
+		clock::time_point now() override { return m_now; }
+		void wait(output_capture& output, std::chrono::milliseconds timeout) override;
+		bool watch(int fd) override;
+		void unwatch(int fd) override;
+		os::signals_ptr create_signals(const logger_ptr& log) override;
+		int listen(const std::string& address) override;
+		void close(int socket) override;
+		int spawn(int stdIn, const spawn_template& tmpl) override;
+		int reap(int& status) override;
+		bool terminate(int pid, bool force) override;
+		int process_group(int pid) override;
+
+		// the script, in virtual time since the simulation was created
+		void at(std::chrono::milliseconds when, const action& fn);
+
+		// to the supervisor, e.g. "stop" or "reload"; runs its handlers at once
+		void raise(const char* sig);
+
+		// a worker, or a random share of all the running ones, dies on its own
+		bool crash(int pid, int status = 128 + 11);
+		size_t crash(double share, int status = 128 + 11);
+
+		size_t running() const;
+		std::chrono::milliseconds elapsed() const;
+		const counters& stats() const { return m_counters; }
+
+		// called from every wait() with the real time the supervisor spent
+		// since the previous one, i.e. the cost of one tick of its loop
+		std::function<void(std::chrono::nanoseconds busy)> on_tick;
+	};
+}
+
+#endif // __LIBREMOTE_SIMULATION_HPP__
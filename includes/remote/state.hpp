@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_STATE_HPP__
+#define __LIBREMOTE_STATE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace remote
+{
+	/*
+	 * Fixed layout of the runtime state file. The supervisor keeps it mapped
+	 * and updates it in place; readers map it, copy it out under the seqlock
+	 * and never talk to the supervisor itself.
+	 *
+	 *   header | pool[pool_capacity] | worker[worker_capacity]
+	 */
+	namespace state_layout
+	{
+		enum : uint32_t
+		{
+			magic = 0x5453524c, // "LRST"
+			version = 2,
+			name_size = 32
+		};
+
+		struct header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t pool_capacity;
+			uint32_t worker_capacity;
+			std::atomic<uint32_t> sequence; // odd while an update is in progress
+			int32_t supervisor;             // pid
+			int64_t started;                // unix time, in milliseconds
+			uint32_t pools;
+			uint32_t workers;
+		};
+
+		struct pool
+		{
+			char name[name_size];
+			uint32_t generation;            // bumped on every restart of the pool
+			uint32_t workers;               // configured
+			int32_t process_group;          // of the workers, 0 if none yet
+		};
+
+		struct worker
+		{
+			int32_t pid;                    // 0 for an empty slot
+			uint32_t pool;                  // index into the pool table
+			uint32_t generation;            // of the pool, when this worker was spawned
+			uint32_t running;               // 1 once the worker got through exec, until it is reaped
+			int64_t started;                // unix time, in milliseconds
+		};
+	}
+
+	struct state_snapshot
+	{
+		int supervisor = 0;
+		int64_t started = 0;
+		std::vector<state_layout::pool> pools;
+		std::vector<state_layout::worker> workers;
+	};
+
+	class state_file
+	{
+		std::string m_path;
+		int m_fd = -1;
+		void* m_data = nullptr;
+		size_t m_size = 0;
+
+		state_layout::header* header() const { return (state_layout::header*)m_data; }
+	public:
+		state_file() = default;
+		// started is the start of the supervisor, 0 for now; a file replaced
+		// by a bigger one passes its own on
+		state_file(const std::string& path, size_t pools, size_t workers, int64_t started = 0);
+		~state_file();
+		state_file(const state_file&) = delete;
+		state_file& operator=(const state_file&) = delete;
+
+		explicit operator bool() const { return !!m_data; }
+		size_t pool_capacity() const { return m_data ? header()->pool_capacity : 0; }
+		size_t worker_capacity() const { return m_data ? header()->worker_capacity : 0; }
+		int64_t started() const { return m_data ? header()->started : 0; }
+
+		// writer side; every change between begin() and commit() is seen by
+		// the readers all at once
+		void begin();
+		void commit();
+		state_layout::pool* pools() const;
+		state_layout::worker* workers() const;
+		void counts(size_t pools, size_t workers);
+
+		// the state file for a pid file: foo.pid -> foo.state
+		static std::string path_for(const std::string& pid_path);
+		// false as well when no consistent copy could be taken within a second
+		static bool read(const std::string& path, state_snapshot& out);
+	};
+}
+
+#endif // __LIBREMOTE_STATE_HPP__
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_SUPERVISOR_HPP__
+#define __LIBREMOTE_SUPERVISOR_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "backend.hpp"
+#include "capture.hpp"
+#include "channel.hpp"
+#include "logger.hpp"
+#include "signals.hpp"
+#include "state.hpp"
+
+namespace remote
+{
+	struct pool_config
+	{
+		std::string name;
+		std::string address;
+		std::vector<std::string> args;
+		std::vector<std::string> env;
+		size_t workers = 1;
+		std::string user;
+		std::string group;
+		std::map<std::string, unsigned long long> limits;
+		bool control = false; // every worker gets its own control_channel
+		output_config output;
+
+		// a worker which did not beat for timeout gets the signal (meant to make it
+		// dump its stacks); if it does not beat again within grace, it is killed
+		// and replaced. Needs the control channel, 0 turns the watchdog off
+		struct watchdog_config
+		{
+			std::chrono::milliseconds timeout{ 0 };
+			std::chrono::milliseconds grace{ 5000 };
+			std::string signal = "SIGQUIT";
+		} watchdog;
+
+		// true, if the workers of the two pools would be spawned the same way; a
+		// reload which only changes control, the watchdog or the output restarts nothing
+		bool same_spawn(const pool_config& oth) const;
+	};
+
+	/*
+	 * The configuration is an INI-style file, one section per pool:
+	 *
+	 *   # comment
+	 *   [pool-name]
+	 *   address = 127.0.0.1:9000
+	 *   exec = /usr/bin/app --config "/etc/app/my app.conf"
+	 *   env = KEY=value          ; may be repeated
+	 *   workers = 4
+	 *   user = www-data
+	 *   group = www-data
+	 *   limit.nofile = 4096      ; any of as, core, cpu, data, fsize, memlock, nofile, nproc, stack
+	 *   control = yes            ; see control_channel
+	 *   output = log             ; or none, or a file: /var/log/app/{pid}.log
+	 *   output.pipe_size = 1048576
+	 *   watchdog = 10000         ; in ms, turns the control channel on, see pool_config::watchdog_config
+	 *   watchdog.grace = 5000
+	 *   watchdog.signal = SIGQUIT
+	 */
+	struct supervisor_config
+	{
+		std::vector<pool_config> pools;
+
+		static bool load(const logger_ptr& log, const std::string& path, supervisor_config& out);
+	};
+
+	class supervisor
+	{
+		struct pool_state;
+		using pools_t = std::map<std::string, std::unique_ptr<pool_state>>;
+		struct draining;
+
+		logger_ptr m_log;
+		std::string m_path;
+		os::backend_ptr m_os;
+		signals m_signals;
+		output_capture m_output;
+		pools_t m_pools;
+		std::vector<draining> m_draining; // workers of stopped pools and dropped slots, until reaped
+		std::unique_ptr<state_file> m_state;
+		bool m_dirty = false;
+		std::atomic<bool> m_stop{ false };
+		std::atomic<bool> m_reload{ false };
+
+		bool start_pool(pool_state& pool);
+		void stop_pool(pool_state& pool);
+		void fill_pool(pool_state& pool);
+		void retire(const pool_state& pool, int pid);
+		bool draining_on(const std::string& address) const;
+		void drain();
+		void reap();
+		void receive();
+		void watch();
+		void apply(supervisor_config& config);
+		void shutdown();
+		void publish();
+	public:
+		std::chrono::milliseconds tick{ 100 };          // how often the pools are looked after
+		std::chrono::milliseconds restart_delay{ 1000 }; // minimal lifetime of a worker before it is respawned right away
+		std::chrono::milliseconds stop_timeout{ 5000 };  // grace period between SIGTERM and SIGKILL on shutdown
+		std::string state_path;                           // runtime state file, see state_file::path_for; none if empty
+
+		// called on the thread of run() for every message, other than a heartbeat,
+		// the workers send up their control channels
+		std::function<void(const std::string& pool, int pid, const control_message& msg)> on_message;
+
+		// the backend is os::native(), unless the supervisor runs in a simulation
+		supervisor(const logger_ptr& log, const std::string& path, const os::backend_ptr& backend = nullptr);
+		~supervisor();
+
+		// runs the pools from the config until "stop" is signalled;
+		// "reload" re-reads the config and restarts only the pools which changed
+		int run();
+
+		void reload() { m_reload = true; }
+		void stop() { m_stop = true; }
+
+		// sends the message down the control channels of all the running workers
+		// of the pool; returns, how many took it. Only from the thread of run(),
+		// e.g. from on_message
+		size_t send(const std::string& pool, const control_message& msg);
+
+		// sends the signal (a name as signals::set takes it) to the running workers
+		// of the pool, with a single kill() of its process group where it has one;
+		// returns, how many workers it reached. Only from the thread of run()
+		size_t signal(const std::string& pool, const char* sig);
+	};
+}
+
+#endif // __LIBREMOTE_SUPERVISOR_HPP__
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBREMOTE_TRACE_HPP__
+#define __LIBREMOTE_TRACE_HPP__
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace remote
+{
+	class trace
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		struct event
+		{
+			std::string name;
+			std::string category;
+			int lane;
+			clock::time_point start;
+			clock::duration duration;
+		};
+
+		class span
+		{
+			trace* m_trace;
+			const char* m_name;
+			const char* m_category;
+			int m_lane;
+			clock::time_point m_start;
+		public:
+			span(trace* tr, const char* name, const char* category = "respawn", int lane = 0)
+				: m_trace(tr)
+				, m_name(name)
+				, m_category(category)
+				, m_lane(lane)
+			{
+				if (m_trace)
+					m_start = clock::now();
+			}
+			span(const span&) = delete;
+			span& operator=(const span&) = delete;
+			~span() { close(); }
+
+			void lane(int lane) { m_lane = lane; }
+			void close()
+			{
+				if (!m_trace)
+					return;
+				m_trace->record(m_name, m_category, m_lane, m_start, clock::now());
+				m_trace = nullptr;
+			}
+		};
+
+		trace();
+
+		void record(const char* name, const char* category, int lane, clock::time_point start, clock::time_point stop);
+		void lane_name(int lane, const std::string& name);
+
+		void write(std::ostream& out) const;
+		bool save(const std::string& path) const;
+	private:
+		mutable std::mutex m_mutex;
+		clock::time_point m_origin;
+		std::vector<event> m_events;
+		std::vector<std::pair<int, std::string>> m_lanes;
+	};
+
+	using trace_ptr = std::shared_ptr<trace>;
+}
+
+#endif // __LIBREMOTE_TRACE_HPP__
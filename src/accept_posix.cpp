@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/accept.hpp>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#endif
+
+namespace remote
+{
+	namespace
+	{
+		int anonymous_file(size_t size)
+		{
+#ifdef __linux__
+			int fd = memfd_create("libremote-accept", MFD_CLOEXEC);
+#else
+			char path[] = "/tmp/libremote-accept.XXXXXX";
+			int fd = mkstemp(path);
+			if (fd >= 0)
+			{
+				unlink(path);
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+			}
+#endif
+			if (fd < 0)
+				return -1;
+
+			if (ftruncate(fd, size))
+			{
+				::close(fd);
+				return -1;
+			}
+
+			return fd;
+		}
+
+		// the mapping is shared between processes, so not FUTEX_PRIVATE_FLAG
+		void sleep_while(std::atomic<int>& word, int value)
+		{
+#ifdef __linux__
+			timespec timeout{ 0, 100 * 1000 * 1000 };
+			syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+#else
+			(void)word;
+			(void)value;
+			timespec timeout{ 0, 1000 * 1000 };
+			nanosleep(&timeout, nullptr);
+#endif
+		}
+
+		void wake_one(std::atomic<int>& word)
+		{
+#ifdef __linux__
+			syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+			(void)word;
+#endif
+		}
+	}
+
+	accept_mutex::accept_mutex()
+	{
+		m_fd = anonymous_file(sizeof(shared));
+		if (m_fd < 0)
+			return;
+
+		void* ptr = mmap(nullptr, sizeof(shared), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (ptr == MAP_FAILED)
+		{
+			::close(m_fd);
+			m_fd = -1;
+			return;
+		}
+
+		m_shared = new (ptr) shared;
+		m_shared->owner.store(0);
+		m_shared->waiters.store(0);
+	}
+
+	accept_mutex::accept_mutex(int fd) : m_fd(fd)
+	{
+		if (m_fd < 0)
+			return;
+
+		void* ptr = mmap(nullptr, sizeof(shared), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (ptr == MAP_FAILED)
+			return;
+
+		m_shared = (shared*)ptr;
+	}
+
+	accept_mutex::accept_mutex(accept_mutex&& oth)
+		: m_fd(oth.m_fd)
+		, m_shared(oth.m_shared)
+	{
+		oth.m_fd = -1;
+		oth.m_shared = nullptr;
+	}
+
+	accept_mutex::~accept_mutex()
+	{
+		if (m_shared)
+			munmap(m_shared, sizeof(shared));
+		if (m_fd >= 0)
+			::close(m_fd);
+	}
+
+	accept_mutex accept_mutex::inherit()
+	{
+		auto value = getenv(env_name);
+		if (!value || !*value)
+			return accept_mutex{ -1 };
+
+		char* end = nullptr;
+		long fd = strtol(value, &end, 10);
+		if (*end || fd < 0)
+			return accept_mutex{ -1 };
+
+		return accept_mutex{ (int)fd };
+	}
+
+	bool accept_mutex::try_lock()
+	{
+		if (!m_shared)
+			return false;
+
+		int owner = m_shared->owner.load(std::memory_order_relaxed);
+
+		// a holder which is gone never unlocks; its lock is taken over instead
+		if (owner && !(::kill(owner, 0) && errno == ESRCH))
+			return false;
+
+		return m_shared->owner.compare_exchange_strong(owner, _getpid(), std::memory_order_acquire);
+	}
+
+	bool accept_mutex::lock()
+	{
+		if (!m_shared)
+			return false;
+
+		while (!try_lock())
+		{
+			int owner = m_shared->owner.load(std::memory_order_relaxed);
+			if (!owner)
+				continue;
+
+			m_shared->waiters.fetch_add(1, std::memory_order_relaxed);
+			sleep_while(m_shared->owner, owner);
+			m_shared->waiters.fetch_sub(1, std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	void accept_mutex::unlock()
+	{
+		if (!m_shared)
+			return;
+
+		int expected = _getpid();
+		if (m_shared->owner.compare_exchange_strong(expected, 0, std::memory_order_seq_cst)
+			&& m_shared->waiters.load(std::memory_order_seq_cst))
+			wake_one(m_shared->owner);
+	}
+
+	bool accept_mutex::force_unlock(int pid)
+	{
+		if (!m_shared || !m_shared->owner.compare_exchange_strong(pid, 0, std::memory_order_seq_cst))
+			return false;
+		if (m_shared->waiters.load(std::memory_order_seq_cst))
+			wake_one(m_shared->owner);
+		return true;
+	}
+
+	bool watch_exclusive(int epoll_fd, int listener)
+	{
+#if defined(__linux__) && defined(EPOLLEXCLUSIVE)
+		epoll_event ev{};
+		ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+		ev.data.fd = listener;
+		return !epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &ev);
+#else
+		return false;
+#endif
+	}
+}
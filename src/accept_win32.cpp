@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/accept.hpp>
+
+namespace remote
+{
+	// the workers do not share a listener through fork() here,
+	// so there is nothing to serialise; like an unattached mutex on posix,
+	// this one is never taken
+
+	accept_mutex::accept_mutex() {}
+	accept_mutex::accept_mutex(int) {}
+	accept_mutex::accept_mutex(accept_mutex&&) {}
+	accept_mutex::~accept_mutex() {}
+
+	accept_mutex accept_mutex::inherit()
+	{
+		return accept_mutex{ -1 };
+	}
+
+	bool accept_mutex::try_lock() { return false; }
+	bool accept_mutex::lock() { return false; }
+	void accept_mutex::unlock() {}
+	bool accept_mutex::force_unlock(int) { return false; }
+
+	bool watch_exclusive(int, int)
+	{
+		return false;
+	}
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "pch.h"
+#include <remote/backend.hpp>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace remote
+{
+	namespace
+	{
+		struct native_backend : os::backend
+		{
+			event_loop_ptr m_loop;
+			std::deque<std::pair<int, int>> m_exited; // pid and status, collected by the loop
+			std::unordered_set<int> m_unwatched;      // workers the loop could not take, reaped one by one
+			std::unordered_map<int, int> m_streams;   // output pipes in the loop, to the pid of their worker
+			std::vector<int> m_ready;                 // output pipes the loop found readable
+			std::weak_ptr<os::signals> m_signals;     // told about every worker, see os::signals::spawned
+
+			explicit native_backend(event_loop::kind loop) : m_loop(event_loop::create(loop)) {}
+
+			clock::time_point now() override { return clock::now(); }
+
+			void wait(output_capture& output, std::chrono::milliseconds timeout) override
+			{
+				if (!m_loop)
+				{
+					output.pump(timeout);
+					return;
+				}
+
+				// a closed pipe's descriptor may come back for the pipe of another worker
+				auto streams = output.streams();
+				std::unordered_map<int, int> current(streams.begin(), streams.end());
+				for (auto it = m_streams.begin(); it != m_streams.end();)
+				{
+					auto now = current.find(it->first);
+					if (now == current.end() || now->second != it->second)
+					{
+						m_loop->unwatch(it->first);
+						it = m_streams.erase(it);
+					}
+					else
+						++it;
+				}
+				for (auto&& stream : current)
+				{
+					if (m_streams.count(stream.first))
+						continue;
+					auto fd = stream.first;
+					if (m_loop->watch(fd, [this, fd] { m_ready.push_back(fd); }))
+						m_streams.insert(stream);
+				}
+
+				// the exits already collected are waiting for reap()
+				m_loop->run_once(m_exited.empty() ? timeout : std::chrono::milliseconds{ 0 });
+				// only the pipes which have something, not a poll() of all of them
+				output.pump(m_ready);
+				m_ready.clear();
+			}
+
+			bool watch(int fd) override
+			{
+				// run_once() returns after the callback, which is all it takes
+				return m_loop && m_loop->watch(fd, [] {});
+			}
+
+			void unwatch(int fd) override
+			{
+				if (m_loop)
+					m_loop->unwatch(fd);
+			}
+
+			os::signals_ptr create_signals(const logger_ptr& log) override
+			{
+				auto out = os::signals::create(log);
+				m_signals = out;
+				return out;
+			}
+
+			int reaped(int pid)
+			{
+				if (auto sig = m_signals.lock())
+					sig->reaped(pid);
+				return pid;
+			}
+
+			int listen(const std::string& address) override
+			{
+				return respawn::listen(address, respawn::options{});
+			}
+
+			void close(int socket) override { os::close(socket); }
+
+			int spawn(int stdIn, const spawn_template& tmpl) override
+			{
+				auto pid = os::spawn(stdIn, tmpl);
+				if (pid <= 0)
+					return pid;
+				if (auto sig = m_signals.lock())
+					sig->spawned(pid);
+				if (m_loop && !m_loop->watch_child(pid, [this](int pid, int status) { m_exited.emplace_back(pid, status); }))
+					m_unwatched.insert(pid);
+				return pid;
+			}
+
+			int reap(int& status) override
+			{
+				if (!m_exited.empty())
+				{
+					auto exit = m_exited.front();
+					m_exited.pop_front();
+					status = exit.second;
+					return reaped(exit.first);
+				}
+
+				// without a loop, nothing else reaps; with one, a waitpid(-1) would
+				// take the workers from under it
+				if (!m_loop)
+				{
+					auto pid = os::reap(status);
+					return pid > 0 ? reaped(pid) : pid;
+				}
+
+				for (auto it = m_unwatched.begin(); it != m_unwatched.end(); ++it)
+				{
+					auto pid = os::reap(*it, status);
+					if (pid > 0)
+					{
+						m_unwatched.erase(it);
+						return reaped(pid);
+					}
+				}
+				return 0;
+			}
+
+			bool terminate(int pid, bool force) override { return os::terminate(pid, force); }
+			int process_group(int pid) override { return os::process_group(pid); }
+		};
+	}
+
+	namespace os
+	{
+		backend_ptr native(event_loop::kind loop)
+		{
+			return std::make_shared<native_backend>(loop);
+		}
+	}
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/binary_log.hpp>
+#include <chrono>
+
+namespace remote
+{
+	namespace
+	{
+		std::atomic<uint32_t> s_next_site{ 0 };
+
+		int64_t now()
+		{
+			using namespace std::chrono;
+			return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+		}
+
+		template <typename T>
+		void put(std::string& out, const T& value)
+		{
+			out.append((const char*)&value, sizeof(value));
+		}
+
+		template <typename T>
+		bool get(std::string_view& in, T& value)
+		{
+			if (in.size() < sizeof(value))
+				return false;
+			memcpy(&value, in.data(), sizeof(value));
+			in.remove_prefix(sizeof(value));
+			return true;
+		}
+
+		template <typename T>
+		bool read(FILE* file, T& value)
+		{
+			return fread(&value, sizeof(value), 1, file) == 1;
+		}
+
+		bool read(FILE* file, std::string& value)
+		{
+			uint32_t length = 0;
+			if (!read(file, length) || length > (64u << 20))
+				return false;
+			value.resize(length);
+			return !length || fread(&value[0], length, 1, file) == 1;
+		}
+	}
+
+	namespace log_arg
+	{
+		bool decode(std::string_view args, std::string& out)
+		{
+			char buffer[64];
+			while (!args.empty())
+			{
+				char tag = args[0];
+				args.remove_prefix(1);
+				switch (tag)
+				{
+				case i64:
+				{
+					int64_t value;
+					if (!get(args, value))
+						return false;
+					out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+					break;
+				}
+				case u64:
+				{
+					uint64_t value;
+					if (!get(args, value))
+						return false;
+					out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+					break;
+				}
+				case f64:
+				{
+					double value;
+					if (!get(args, value))
+						return false;
+					// what a default ostream prints
+					snprintf(buffer, sizeof(buffer), "%g", value);
+					out.append(buffer);
+					break;
+				}
+				case chr:
+				{
+					char value;
+					if (!get(args, value))
+						return false;
+					out.push_back(value);
+					break;
+				}
+				case boolean:
+				{
+					char value;
+					if (!get(args, value))
+						return false;
+					out.push_back(value ? '1' : '0');
+					break;
+				}
+				case str:
+				{
+					uint32_t length;
+					if (!get(args, length) || args.size() < length)
+						return false;
+					out.append(args.data(), length);
+					args.remove_prefix(length);
+					break;
+				}
+				default:
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	namespace binary_log
+	{
+		reader::reader(const std::string& path)
+		{
+			m_file = fopen(path.c_str(), "rb");
+			if (!m_file)
+				return;
+
+			uint32_t head[2];
+			m_valid = fread(head, sizeof(head), 1, m_file) == 1 && head[0] == magic && head[1] == version;
+		}
+
+		reader::~reader()
+		{
+			if (m_file)
+				fclose(m_file);
+		}
+
+		bool reader::next(entry& out)
+		{
+			if (!m_valid)
+				return false;
+
+			for (;;)
+			{
+				char kind;
+				if (!read(m_file, kind))
+					return false;
+
+				switch (kind)
+				{
+				case site:
+				{
+					uint32_t id, line;
+					std::string file;
+					if (!read(m_file, id) || !read(m_file, line) || !read(m_file, file) || !id || id > (1u << 24))
+						return m_valid = false;
+					if (m_sites.size() <= id)
+						m_sites.resize(id + 1);
+					m_sites[id] = { std::move(file), (int)line };
+					continue;
+				}
+				case binary_log::line:
+				{
+					uint32_t id;
+					if (!read(m_file, id) || !read(m_file, out.time) || !read(m_file, m_args) || id >= m_sites.size())
+						return m_valid = false;
+
+					out.file = m_sites[id].first;
+					out.line = m_sites[id].second;
+					out.text.clear();
+					if (!log_arg::decode(m_args, out.text))
+						return m_valid = false;
+					return true;
+				}
+				case text:
+				{
+					uint32_t line;
+					if (!read(m_file, out.time) || !read(m_file, line) || !read(m_file, out.file) || !read(m_file, out.text))
+						return m_valid = false;
+					out.line = (int)line;
+					return true;
+				}
+				default:
+					return m_valid = false;
+				}
+			}
+		}
+	}
+
+	binary_logger::binary_logger(const std::string& path)
+	{
+		binary = true;
+
+		m_file = fopen(path.c_str(), "wb");
+		if (!m_file)
+			return;
+
+		m_buffer.reserve(128 * 1024);
+		put(m_buffer, (uint32_t)binary_log::magic);
+		put(m_buffer, (uint32_t)binary_log::version);
+	}
+
+	binary_logger::~binary_logger()
+	{
+		if (!m_file)
+			return;
+
+		flush_locked();
+		fclose(m_file);
+	}
+
+	void binary_logger::describe(const log_site& site, uint32_t id)
+	{
+		if (m_described.size() <= id)
+			m_described.resize(id + 1);
+		if (m_described[id])
+			return;
+		m_described[id] = true;
+
+		uint32_t length = site.file ? (uint32_t)strlen(site.file) : 0;
+		m_buffer.push_back(binary_log::site);
+		put(m_buffer, id);
+		put(m_buffer, (uint32_t)site.line);
+		put(m_buffer, length);
+		m_buffer.append(site.file ? site.file : "", length);
+	}
+
+	void binary_logger::write(const log_site& site, std::string_view args)
+	{
+		auto time = now();
+
+		auto id = site.id.load(std::memory_order_acquire);
+		if (!id)
+		{
+			uint32_t next = ++s_next_site;
+			id = site.id.compare_exchange_strong(id, next) ? next : id;
+		}
+
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (!m_file)
+			return;
+
+		describe(site, id);
+		m_buffer.push_back(binary_log::line);
+		put(m_buffer, id);
+		put(m_buffer, time);
+		put(m_buffer, (uint32_t)args.size());
+		m_buffer.append(args.data(), args.size());
+
+		if (m_buffer.size() >= 64 * 1024)
+			flush_locked();
+	}
+
+	void binary_logger::write(const char* path, int line, std::string_view text)
+	{
+		auto time = now();
+		uint32_t length = path ? (uint32_t)strlen(path) : 0;
+
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (!m_file)
+			return;
+
+		m_buffer.push_back(binary_log::text);
+		put(m_buffer, time);
+		put(m_buffer, (uint32_t)line);
+		put(m_buffer, length);
+		m_buffer.append(path ? path : "", length);
+		put(m_buffer, (uint32_t)text.size());
+		m_buffer.append(text.data(), text.size());
+
+		if (m_buffer.size() >= 64 * 1024)
+			flush_locked();
+	}
+
+	void binary_logger::flush_locked()
+	{
+		if (!m_buffer.empty())
+			fwrite(m_buffer.data(), m_buffer.size(), 1, m_file);
+		m_buffer.clear();
+		fflush(m_file);
+	}
+
+	void binary_logger::flush()
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (m_file)
+			flush_locked();
+	}
+}
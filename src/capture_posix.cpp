@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/capture.hpp>
+#include <unordered_set>
+#include <poll.h>
+
+namespace remote
+{
+	struct output_capture::stream
+	{
+		int pid = 0;
+		std::string tag;
+		int read = -1;
+		int file = -1;
+		output_config::target to = output_config::target::discard;
+		bool shared = false; // the file is not the worker's own, the lines are tagged and appended
+		std::string partial; // the logger target and a shared file: the last line, until its '\n' comes
+
+		~stream()
+		{
+			if (read >= 0)
+				::close(read);
+			if (file >= 0)
+				::close(file);
+		}
+	};
+
+	namespace
+	{
+		size_t pipe_max_size()
+		{
+			static size_t max = []
+			{
+				size_t out = 0;
+				auto f = fopen("/proc/sys/fs/pipe-max-size", "r");
+				if (f)
+				{
+					unsigned long value = 0;
+					if (fscanf(f, "%lu", &value) == 1)
+						out = value;
+					fclose(f);
+				}
+				return out;
+			}();
+			return max;
+		}
+
+		std::string expand(const std::string& path, int pid)
+		{
+			static const char placeholder[] = "{pid}";
+			auto pos = path.find(placeholder);
+			if (pos == std::string::npos)
+				return path;
+
+			std::ostringstream o;
+			o << path.substr(0, pos) << pid << path.substr(pos + sizeof(placeholder) - 1);
+			return o.str();
+		}
+
+		// the worker's own file; false on EOF, true while the worker may still
+		// write. A file which cannot take any more sets failed, what is left
+		// stays in the pipe (but for the one buffer of the read() fallback)
+		bool move_to_file(int from, int to, bool& failed)
+		{
+			for (;;)
+			{
+				ssize_t moved;
+#ifdef __linux__
+				moved = splice(from, nullptr, to, nullptr, 1024 * 1024, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+				{
+					char buffer[16384];
+					moved = ::read(from, buffer, sizeof(buffer));
+					if (moved > 0 && ::write(to, buffer, moved) != moved)
+					{
+						failed = true;
+						return true;
+					}
+				}
+#endif
+
+				if (moved > 0)
+					continue;
+				if (!moved)
+					return false;
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN)
+					return true;
+				// the pipe does not fail on its own, it is the file: ENOSPC, EFBIG...
+				failed = true;
+				return true;
+			}
+		}
+
+		// a line the worker never ends is cut here, so it cannot take all the memory
+		const size_t max_line = 64 * 1024;
+
+		// reads all there is and hands fn one complete line at a time, without its
+		// '\n'; the rest waits in partial. Same result as move_to_file()
+		template <typename Line>
+		bool read_lines(int from, std::string& partial, Line&& fn)
+		{
+			char buffer[16384];
+			for (;;)
+			{
+				auto got = ::read(from, buffer, sizeof(buffer));
+				if (got < 0 && errno == EINTR)
+					continue;
+				if (got <= 0)
+					return got < 0 && errno == EAGAIN;
+
+				const char* line = buffer;
+				const char* end = buffer + got;
+				while (line < end)
+				{
+					auto nl = (const char*)memchr(line, '\n', end - line);
+					if (!nl)
+					{
+						partial.append(line, end);
+						if (partial.size() >= max_line)
+						{
+							fn(partial.data(), partial.size());
+							partial.clear();
+						}
+						break;
+					}
+
+					if (partial.empty())
+						fn(line, (size_t)(nl - line));
+					else
+					{
+						partial.append(line, nl);
+						fn(partial.data(), partial.size());
+						partial.clear();
+					}
+					line = nl + 1;
+				}
+			}
+		}
+
+		// a single write(), which O_APPEND keeps in one piece next to the lines
+		// of the other workers; on a failure the lines are left for the caller
+		bool append(int file, std::string& lines)
+		{
+			if (lines.empty())
+				return true;
+			if (::write(file, lines.data(), lines.size()) != (ssize_t)lines.size())
+				return false;
+			lines.clear();
+			return true;
+		}
+	}
+
+	output_capture::output_capture(const logger_ptr& log) : m_log(log)
+	{
+	}
+
+	output_capture::~output_capture()
+	{
+	}
+
+	bool output_capture::open(const output_config& conf, output_pipe& out)
+	{
+		out.read = out.write = -1;
+		if (conf.to == output_config::target::discard)
+			return false;
+
+		int fds[2];
+		if (pipe2(fds, O_CLOEXEC))
+			return false;
+
+		fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+#ifdef F_SETPIPE_SZ
+		auto size = conf.pipe_size;
+		auto max = pipe_max_size();
+		if (max && size > max)
+			size = max;
+		if (size)
+			fcntl(fds[1], F_SETPIPE_SZ, (int)size);
+#endif
+
+		out.read = fds[0];
+		out.write = fds[1];
+		return true;
+	}
+
+	void output_capture::attach(int pid, output_pipe& pipe, const output_config& conf, const std::string& tag)
+	{
+		if (pipe.write >= 0)
+			::close(pipe.write);
+		pipe.write = -1;
+
+		if (pipe.read < 0)
+			return;
+
+		std::unique_ptr<stream> out{ new stream };
+		out->read = pipe.read;
+		pipe.read = -1;
+
+		if (pid <= 0)
+			return;
+
+		out->pid = pid;
+		out->tag = tag;
+		out->to = conf.to;
+
+		if (conf.to == output_config::target::file)
+		{
+			auto path = expand(conf.path, pid);
+			out->shared = path == conf.path;
+			out->file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (out->shared ? O_APPEND : 0), 0640);
+			if (out->file >= 0 && !out->shared)
+				lseek(out->file, 0, SEEK_END);
+			if (out->file < 0)
+			{
+				// closing the pipe would kill the worker with SIGPIPE on its first write
+				LOG(m_log) << '[' << tag << "] " << path << ": cannot open, the output of " << pid << " goes to the log";
+				out->to = output_config::target::logger;
+			}
+		}
+
+		m_streams.push_back(std::move(out));
+	}
+
+	void output_capture::close(size_t index)
+	{
+		auto& s = *m_streams[index];
+		if (s.to == output_config::target::logger && !s.partial.empty())
+			LOG(m_log) << '[' << s.tag << ':' << s.pid << "] " << s.partial;
+		else if (s.shared && !s.partial.empty())
+		{
+			std::ostringstream line;
+			line << '[' << s.tag << ':' << s.pid << "] " << s.partial << '\n';
+			auto out = line.str();
+			append(s.file, out);
+		}
+
+		m_streams.erase(m_streams.begin() + index);
+	}
+
+	std::vector<std::pair<int, int>> output_capture::streams() const
+	{
+		std::vector<std::pair<int, int>> out;
+		out.reserve(m_streams.size());
+		for (auto&& s : m_streams)
+			out.emplace_back(s->read, s->pid);
+		return out;
+	}
+
+	void output_capture::pump(std::chrono::milliseconds timeout)
+	{
+		std::vector<pollfd> fds(m_streams.size());
+		for (size_t i = 0; i < m_streams.size(); ++i)
+			fds[i] = pollfd{ m_streams[i]->read, POLLIN, 0 };
+
+		int ready = poll(fds.data(), fds.size(), (int)timeout.count());
+		if (ready <= 0)
+			return;
+
+		for (size_t i = fds.size(); i-- > 0;)
+		{
+			if (fds[i].revents && !forward(*m_streams[i]))
+				close(i);
+		}
+	}
+
+	void output_capture::pump(const std::vector<int>& ready)
+	{
+		if (ready.empty())
+			return;
+
+		// one pass over the streams; the indices move, as the closed ones go
+		std::unordered_set<int> fds(ready.begin(), ready.end());
+		for (size_t i = m_streams.size(); i-- > 0;)
+		{
+			if (fds.count(m_streams[i]->read) && !forward(*m_streams[i]))
+				close(i);
+		}
+	}
+
+	bool output_capture::forward(stream& s)
+	{
+		bool open = true;
+		bool failed = false;
+		int error = 0;
+		if (s.to == output_config::target::file && !s.shared)
+		{
+			open = move_to_file(s.read, s.file, failed);
+			error = errno;
+		}
+		else if (s.to == output_config::target::file)
+		{
+			// the file name cannot tell the workers apart, so every line is tagged
+			// like the log does it; that needs the bytes, splice() is out of the
+			// question (and refuses O_APPEND files anyway)
+			std::ostringstream prefix;
+			prefix << '[' << s.tag << ':' << s.pid << "] ";
+			auto tag = prefix.str();
+			std::string lines;
+			open = read_lines(s.read, s.partial, [&](const char* line, size_t size)
+			{
+				if (failed)
+				{
+					LOG(m_log) << tag << std::string(line, size);
+					return;
+				}
+				lines.append(tag).append(line, size).push_back('\n');
+				if (lines.size() >= 64 * 1024 && !append(s.file, lines))
+				{
+					failed = true;
+					error = errno;
+				}
+			});
+			if (!failed && !append(s.file, lines))
+			{
+				failed = true;
+				error = errno;
+			}
+
+			// the lines the file did not take, already tagged
+			for (size_t pos = 0; pos < lines.size();)
+			{
+				auto nl = lines.find('\n', pos);
+				LOG(m_log) << lines.substr(pos, nl - pos);
+				pos = nl + 1;
+			}
+		}
+		else
+		{
+			open = read_lines(s.read, s.partial, [&](const char* line, size_t size)
+			{
+				LOG(m_log) << '[' << s.tag << ':' << s.pid << "] " << std::string(line, size);
+			});
+		}
+
+		if (failed)
+		{
+			// as in open(): closing the pipe would kill the worker with SIGPIPE
+			LOG(m_log) << '[' << s.tag << "] cannot write to the output file: " << strerror(error) << ", the output of " << s.pid << " goes to the log";
+			::close(s.file);
+			s.file = -1;
+			s.shared = false;
+			s.to = output_config::target::logger;
+			if (open)
+				open = forward(s);
+		}
+
+		return open;
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/capture.hpp>
+
+namespace remote
+{
+	// the workers keep INVALID_HANDLE_VALUE for their output here,
+	// FastCGI expects nothing but the socket
+
+	struct output_capture::stream {};
+
+	output_capture::output_capture(const logger_ptr& log) : m_log(log) {}
+	output_capture::~output_capture() {}
+	void output_capture::close(size_t) {}
+
+	bool output_capture::open(const output_config&, output_pipe& out)
+	{
+		out.read = out.write = -1;
+		return false;
+	}
+
+	void output_capture::attach(int, output_pipe&, const output_config&, const std::string&) {}
+
+	void output_capture::pump(std::chrono::milliseconds timeout)
+	{
+		std::this_thread::sleep_for(timeout);
+	}
+
+	std::vector<std::pair<int, int>> output_capture::streams() const
+	{
+		return {};
+	}
+
+	void output_capture::pump(const std::vector<int>&) {}
+}
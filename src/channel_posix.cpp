@@ -0,0 +1,462 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/channel.hpp>
+#include <sys/mman.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+namespace remote
+{
+	/*
+	 * Everything in here is shared with the other side, which may be buggy
+	 * or hostile: the capacity (as the mask) and the receiver's position are
+	 * kept in the control_channel objects instead, so whatever a worker writes
+	 * to the ring, the supervisor never indexes outside of it, and a sequence
+	 * which never comes right does not keep it in push() either.
+	 */
+	struct control_channel::ring
+	{
+		struct slot
+		{
+			std::atomic<uint64_t> sequence; // position + 1, once the message is in
+			control_message msg;
+		};
+
+		alignas(64) std::atomic<uint64_t> head; // next position for the senders
+		std::atomic<uint32_t> waiting;          // the receiver sleeps on its doorbell
+
+		slot* slots() { return reinterpret_cast<slot*>(this + 1); }
+
+		static size_t size(uint32_t capacity) { return sizeof(ring) + capacity * sizeof(slot); }
+
+		void init(uint32_t capacity)
+		{
+			head.store(0);
+			waiting.store(0);
+			auto ptr = slots();
+			for (uint32_t i = 0; i < capacity; ++i)
+				new (ptr + i) slot{ { i }, {} };
+		}
+
+		bool push(const control_message& msg, uint32_t mask)
+		{
+			auto pos = head.load(std::memory_order_relaxed);
+			for (int tries = 0; tries < 1024; ++tries)
+			{
+				auto cell = slots() + (pos & mask);
+				auto seq = cell->sequence.load(std::memory_order_acquire);
+				auto diff = (int64_t)(seq - pos);
+				if (diff < 0)
+					return false;
+				if (diff > 0)
+				{
+					pos = head.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (!head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					continue;
+
+				cell->msg = msg;
+				cell->sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+
+			// the senders of a sane ring are not that many
+			return false;
+		}
+
+		bool pop(control_message& msg, uint32_t mask, uint64_t& tail)
+		{
+			auto cell = slots() + (tail & mask);
+			if (cell->sequence.load(std::memory_order_acquire) != tail + 1)
+				return false;
+
+			msg = cell->msg;
+			cell->sequence.store(tail + mask + 1, std::memory_order_release);
+			++tail;
+			return true;
+		}
+
+		bool empty(uint32_t mask, uint64_t tail)
+		{
+			return slots()[tail & mask].sequence.load(std::memory_order_acquire) != tail + 1;
+		}
+	};
+
+	namespace
+	{
+		enum : uint32_t { channel_magic = 0x4c43524c }; // "LRCL"
+
+		struct channel_header
+		{
+			uint32_t magic;
+			uint32_t capacity;
+			uint64_t ring_size;
+			std::atomic<int64_t> beat; // steady_clock, in nanoseconds; 0 before the first one
+		};
+
+		constexpr size_t header_size = 64;
+		static_assert(sizeof(channel_header) <= header_size, "the rings are cache line aligned");
+
+		int anonymous_file(size_t size)
+		{
+#ifdef __linux__
+			int fd = memfd_create("libremote-control", MFD_CLOEXEC);
+#else
+			char path[] = "/tmp/libremote-control.XXXXXX";
+			int fd = mkstemp(path);
+			if (fd >= 0)
+			{
+				unlink(path);
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+			}
+#endif
+			if (fd < 0)
+				return -1;
+
+			if (ftruncate(fd, size))
+			{
+				::close(fd);
+				return -1;
+			}
+
+			return fd;
+		}
+
+		bool doorbell(int (&fds)[2])
+		{
+#ifdef __linux__
+			fds[0] = fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			return fds[0] >= 0;
+#else
+			if (pipe(fds))
+				return false;
+			for (int fd : fds)
+			{
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+			}
+			return true;
+#endif
+		}
+
+		void ring_bell(int fd)
+		{
+#ifdef __linux__
+			uint64_t one = 1;
+			auto ret = ::write(fd, &one, sizeof(one));
+#else
+			char one = 1;
+			auto ret = ::write(fd, &one, sizeof(one));
+#endif
+			(void)ret;
+		}
+
+		void silence_bell(int fd)
+		{
+			char buffer[64];
+			while (::read(fd, buffer, sizeof(buffer)) > 0)
+				;
+		}
+
+		uint32_t round_up(size_t capacity)
+		{
+			uint32_t out = 2;
+			while (out < capacity && out < (1u << 20))
+				out <<= 1;
+			return out;
+		}
+	}
+
+	control_channel::control_channel(size_t capacity)
+	{
+		auto slots = round_up(capacity);
+		auto ring_size = (ring::size(slots) + 63) & ~(size_t)63;
+
+		m_fd = anonymous_file(header_size + 2 * ring_size);
+		if (m_fd < 0)
+			return;
+
+		if (!doorbell(m_doorbells[0]) || !doorbell(m_doorbells[1]) || !map(header_size + 2 * ring_size))
+		{
+			release();
+			return;
+		}
+
+		auto header = (channel_header*)m_memory;
+		header->magic = channel_magic;
+		header->capacity = slots;
+		header->ring_size = ring_size;
+		header->beat.store(0);
+		m_rings[0]->init(slots);
+		m_rings[1]->init(slots);
+		m_mask = slots - 1;
+	}
+
+	control_channel::~control_channel()
+	{
+		release();
+	}
+
+	control_channel::control_channel(control_channel&& oth)
+	{
+		*this = std::move(oth);
+	}
+
+	control_channel& control_channel::operator=(control_channel&& oth)
+	{
+		if (this == &oth)
+			return *this;
+
+		release();
+		m_fd = oth.m_fd;
+		memcpy(m_doorbells, oth.m_doorbells, sizeof(m_doorbells));
+		m_memory = oth.m_memory;
+		m_size = oth.m_size;
+		m_rings[0] = oth.m_rings[0];
+		m_rings[1] = oth.m_rings[1];
+		m_mask = oth.m_mask;
+		m_tail = oth.m_tail;
+		m_worker = oth.m_worker;
+
+		oth.m_fd = -1;
+		oth.m_doorbells[0][0] = oth.m_doorbells[0][1] = oth.m_doorbells[1][0] = oth.m_doorbells[1][1] = -1;
+		oth.m_memory = nullptr;
+		oth.m_size = 0;
+		oth.m_rings[0] = oth.m_rings[1] = nullptr;
+		return *this;
+	}
+
+	bool control_channel::map(size_t size)
+	{
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (ptr == MAP_FAILED)
+			return false;
+
+		m_memory = ptr;
+		m_size = size;
+		auto ring_size = (size - header_size) / 2;
+		m_rings[0] = (ring*)((char*)ptr + header_size);
+		m_rings[1] = (ring*)((char*)ptr + header_size + ring_size);
+		return true;
+	}
+
+	void control_channel::release()
+	{
+		if (m_memory)
+			munmap(m_memory, m_size);
+		m_memory = nullptr;
+		m_rings[0] = m_rings[1] = nullptr;
+
+		for (auto& bell : m_doorbells)
+		{
+			if (bell[0] >= 0)
+				::close(bell[0]);
+			if (bell[1] >= 0 && bell[1] != bell[0])
+				::close(bell[1]);
+			bell[0] = bell[1] = -1;
+		}
+
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_fd = -1;
+	}
+
+	control_channel control_channel::inherit()
+	{
+		control_channel out;
+
+		auto value = getenv(env_name);
+		if (!value || !*value)
+			return out;
+
+		// memory,down-read,down-write,up-read,up-write
+		long fds[5];
+		for (auto& fd : fds)
+		{
+			char* end = nullptr;
+			fd = strtol(value, &end, 10);
+			if (end == value || fd < 0 || (*end && *end != ','))
+				return out;
+			value = *end ? end + 1 : end;
+		}
+
+		struct stat st;
+		if (fstat((int)fds[0], &st) || (size_t)st.st_size <= header_size)
+			return out;
+
+		out.m_fd = (int)fds[0];
+		out.m_doorbells[0][0] = (int)fds[1];
+		out.m_doorbells[0][1] = (int)fds[2];
+		out.m_doorbells[1][0] = (int)fds[3];
+		out.m_doorbells[1][1] = (int)fds[4];
+		out.m_worker = true;
+
+		if (!out.map((size_t)st.st_size))
+			return out;
+
+		// read once: the capacity has to fit the rings the size says there are
+		auto header = (channel_header*)out.m_memory;
+		auto capacity = header->capacity;
+		auto ring_size = header->ring_size;
+		bool valid = header->magic == channel_magic
+			&& capacity >= 2 && capacity <= (1u << 20) && !(capacity & (capacity - 1))
+			&& ring::size(capacity) <= ring_size
+			&& header_size + 2 * ring_size == (size_t)st.st_size;
+		if (valid)
+			out.m_mask = capacity - 1;
+		else
+		{
+			munmap(out.m_memory, out.m_size);
+			out.m_memory = nullptr;
+			out.m_rings[0] = out.m_rings[1] = nullptr;
+		}
+
+		return out;
+	}
+
+	std::vector<int> control_channel::fds() const
+	{
+		std::vector<int> out{ m_fd };
+		for (auto& bell : m_doorbells)
+		{
+			out.push_back(bell[0]);
+			if (bell[1] != bell[0])
+				out.push_back(bell[1]);
+		}
+		return out;
+	}
+
+	std::string control_channel::env() const
+	{
+		std::ostringstream o;
+		o << env_name << '=' << m_fd
+			<< ',' << m_doorbells[0][0] << ',' << m_doorbells[0][1]
+			<< ',' << m_doorbells[1][0] << ',' << m_doorbells[1][1];
+		return o.str();
+	}
+
+	bool control_channel::send(const control_message& msg)
+	{
+		auto box = outbox();
+		if (!box || !box->push(msg, m_mask))
+			return false;
+
+		// pairs with the fence in arm(): either the receiver sees the message,
+		// or this side sees it waiting
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (box->waiting.load(std::memory_order_relaxed) && box->waiting.exchange(0))
+			ring_bell(outbox_bell());
+
+		return true;
+	}
+
+	bool control_channel::send(uint32_t type, const void* payload, size_t size)
+	{
+		if (size > control_message::payload_size)
+			return false;
+
+		control_message msg;
+		msg.type = type;
+		msg.size = (uint32_t)size;
+		if (size)
+			memcpy(msg.payload, payload, size);
+		return send(msg);
+	}
+
+	bool control_channel::receive(control_message& msg)
+	{
+		auto box = inbox();
+		if (!box)
+			return false;
+
+		// the other side fills in the size; one which does not fit the payload is skipped
+		while (box->pop(msg, m_mask, m_tail))
+		{
+			if (msg.size <= control_message::payload_size)
+				return true;
+		}
+		return false;
+	}
+
+	void control_channel::beat()
+	{
+		if (!m_memory)
+			return;
+
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		((channel_header*)m_memory)->beat.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), std::memory_order_relaxed);
+	}
+
+	std::chrono::steady_clock::time_point control_channel::last_beat() const
+	{
+		if (!m_memory)
+			return std::chrono::steady_clock::time_point{};
+
+		auto beat = ((channel_header*)m_memory)->beat.load(std::memory_order_relaxed);
+		return std::chrono::steady_clock::time_point{ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds{ beat }) };
+	}
+
+	bool control_channel::arm()
+	{
+		auto box = inbox();
+		if (!box)
+			return false;
+
+		// still armed, if no sender took the flag since: the bell is silent then,
+		// and a poll loop re-arming every channel on every tick costs no syscall
+		if (!box->waiting.load(std::memory_order_relaxed))
+		{
+			silence_bell(inbox_bell());
+			box->waiting.store(1, std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!box->empty(m_mask, m_tail))
+		{
+			box->waiting.store(0, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	bool control_channel::wait(std::chrono::milliseconds timeout)
+	{
+		auto box = inbox();
+		if (!box)
+			return false;
+
+		if (!arm())
+			return true;
+
+		pollfd pfd{ inbox_bell(), POLLIN, 0 };
+		poll(&pfd, 1, (int)timeout.count());
+
+		box->waiting.store(0, std::memory_order_relaxed);
+		return !box->empty(m_mask, m_tail);
+	}
+}
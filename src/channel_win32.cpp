@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/channel.hpp>
+
+namespace remote
+{
+	// the rings are built on inherited descriptors and eventfds;
+	// there is no channel to hand down here
+
+	struct control_channel::ring {};
+
+	control_channel::control_channel(size_t) {}
+	control_channel::~control_channel() {}
+	control_channel::control_channel(control_channel&&) {}
+	control_channel& control_channel::operator=(control_channel&&) { return *this; }
+	bool control_channel::map(size_t) { return false; }
+	void control_channel::release() {}
+
+	control_channel control_channel::inherit()
+	{
+		return control_channel{};
+	}
+
+	std::vector<int> control_channel::fds() const { return std::vector<int>(); }
+	std::string control_channel::env() const { return std::string(); }
+	bool control_channel::send(const control_message&) { return false; }
+	bool control_channel::send(uint32_t, const void*, size_t) { return false; }
+	bool control_channel::receive(control_message&) { return false; }
+	void control_channel::beat() {}
+	std::chrono::steady_clock::time_point control_channel::last_beat() const { return std::chrono::steady_clock::time_point{}; }
+	bool control_channel::arm() { return false; }
+	bool control_channel::wait(std::chrono::milliseconds) { return false; }
+}
@@ -0,0 +1,574 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/compressed_log.hpp>
+#include <chrono>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define O_CLOEXEC 0
+#define ftruncate _chsize_s
+#endif
+
+namespace remote
+{
+	namespace
+	{
+		struct frame_header
+		{
+			uint32_t magic;
+			uint32_t flags;
+			uint32_t raw_size;
+			uint32_t stored_size;
+			uint32_t checksum;
+			uint32_t unused;
+			uint64_t raw_offset;
+			int64_t time;
+		};
+
+		struct file_header
+		{
+			uint32_t magic;
+			uint32_t version;
+		};
+
+		static_assert(sizeof(frame_header) == 40, "the frame header is part of the file format");
+
+		int64_t now()
+		{
+			using namespace std::chrono;
+			return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+		}
+
+		uint32_t checksum(const char* data, size_t size)
+		{
+			uint32_t hash = 2166136261u;
+			for (size_t i = 0; i < size; ++i)
+				hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+			return hash;
+		}
+
+		bool write_all(int fd, const char* data, size_t size)
+		{
+			while (size)
+			{
+				auto written = ::write(fd, data, (unsigned)size);
+				if (written < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return false;
+				}
+				data += written;
+				size -= (size_t)written;
+			}
+			return true;
+		}
+	}
+
+	namespace lz4
+	{
+		namespace
+		{
+			constexpr unsigned hash_bits = 12;
+			constexpr size_t min_match = 4;
+			constexpr size_t max_offset = 65535;
+			constexpr size_t last_literals = 5;   // the block always ends with that many
+			constexpr size_t match_limit = 12;    // no match starts closer to the end
+
+			uint32_t read32(const uint8_t* ptr)
+			{
+				uint32_t value;
+				memcpy(&value, ptr, sizeof(value));
+				return value;
+			}
+
+			unsigned hash(uint32_t sequence)
+			{
+				return (sequence * 2654435761u) >> (32 - hash_bits);
+			}
+
+			uint8_t* length(uint8_t* out, size_t rest)
+			{
+				while (rest >= 255)
+				{
+					*out++ = 255;
+					rest -= 255;
+				}
+				*out++ = (uint8_t)rest;
+				return out;
+			}
+
+			uint8_t* literals(uint8_t* out, uint8_t*& token, const uint8_t* from, size_t count)
+			{
+				token = out++;
+				*token = (uint8_t)(std::min(count, (size_t)15) << 4);
+				if (count >= 15)
+					out = length(out, count - 15);
+				memcpy(out, from, count);
+				return out + count;
+			}
+		}
+
+		size_t compress(const void* src, size_t size, void* dst)
+		{
+			auto const in = (const uint8_t*)src;
+			auto const end = in + size;
+			auto out = (uint8_t*)dst;
+			auto ip = in;
+			auto anchor = in;
+			uint8_t* token = nullptr;
+
+			if (size > match_limit)
+			{
+				uint32_t table[1 << hash_bits] = {};
+				auto const last_start = end - match_limit;
+				auto const last_match = end - last_literals;
+				unsigned misses = 0;
+
+				++ip;
+				while (ip < last_start)
+				{
+					auto sequence = read32(ip);
+					auto& slot = table[hash(sequence)];
+					auto ref = in + slot;
+					slot = (uint32_t)(ip - in);
+
+					if ((size_t)(ip - ref) > max_offset || read32(ref) != sequence)
+					{
+						// the further the last match, the bigger the steps
+						ip += 1 + (misses++ >> 6);
+						continue;
+					}
+					misses = 0;
+
+					while (ip > anchor && ref > in && ip[-1] == ref[-1])
+					{
+						--ip;
+						--ref;
+					}
+
+					auto match_end = ip + min_match;
+					auto ref_end = ref + min_match;
+					while (match_end < last_match && *match_end == *ref_end)
+					{
+						++match_end;
+						++ref_end;
+					}
+
+					out = literals(out, token, anchor, (size_t)(ip - anchor));
+
+					auto offset = (size_t)(ip - ref);
+					*out++ = (uint8_t)offset;
+					*out++ = (uint8_t)(offset >> 8);
+
+					auto match = (size_t)(match_end - ip) - min_match;
+					*token |= (uint8_t)std::min(match, (size_t)15);
+					if (match >= 15)
+						out = length(out, match - 15);
+
+					ip = anchor = match_end;
+				}
+			}
+
+			out = literals(out, token, anchor, (size_t)(end - anchor));
+			return (size_t)(out - (uint8_t*)dst);
+		}
+
+		bool decompress(const void* src, size_t size, void* dst, size_t raw_size)
+		{
+			auto ip = (const uint8_t*)src;
+			auto const iend = ip + size;
+			auto const begin = (uint8_t*)dst;
+			auto op = begin;
+			auto const oend = op + raw_size;
+
+			auto read_length = [&](size_t& value)
+			{
+				uint8_t next;
+				do
+				{
+					if (ip == iend)
+						return false;
+					next = *ip++;
+					value += next;
+				} while (next == 255);
+				return true;
+			};
+
+			while (ip < iend)
+			{
+				auto token = *ip++;
+
+				size_t count = token >> 4;
+				if (count == 15 && !read_length(count))
+					return false;
+				if (count > (size_t)(iend - ip) || count > (size_t)(oend - op))
+					return false;
+				memcpy(op, ip, count);
+				op += count;
+				ip += count;
+
+				// the last sequence has no match
+				if (ip == iend)
+					break;
+
+				if (iend - ip < 2)
+					return false;
+				size_t offset = ip[0] | (ip[1] << 8);
+				ip += 2;
+				if (!offset || offset > (size_t)(op - begin))
+					return false;
+
+				size_t match = token & 15;
+				if (match == 15 && !read_length(match))
+					return false;
+				match += min_match;
+				if (match > (size_t)(oend - op))
+					return false;
+
+				// byte by byte: the match may overlap what it is copying
+				auto from = op - offset;
+				for (size_t i = 0; i < match; ++i)
+					op[i] = from[i];
+				op += match;
+			}
+
+			return op == oend;
+		}
+	}
+
+	namespace compressed_log
+	{
+		reader::reader(const std::string& path)
+		{
+			m_file = fopen(path.c_str(), "rb");
+			if (!m_file)
+				return;
+
+			file_header header;
+			if (fread(&header, sizeof(header), 1, m_file) != 1 || header.magic != magic || header.version != version)
+				return;
+
+			if (fseek(m_file, 0, SEEK_END))
+				return;
+			m_size = (uint64_t)ftell(m_file);
+			m_next = sizeof(header);
+			m_valid = true;
+		}
+
+		reader::~reader()
+		{
+			if (m_file)
+				fclose(m_file);
+		}
+
+		bool reader::next(frame& out)
+		{
+			frame_header header;
+			if (!m_valid || m_next + sizeof(header) > m_size)
+				return false;
+
+			if (fseek(m_file, (long)m_next, SEEK_SET) || fread(&header, sizeof(header), 1, m_file) != 1)
+				return false;
+
+			if (header.magic != frame_magic || header.flags > lz4_block || m_next + sizeof(header) + header.stored_size > m_size)
+				return false;
+
+			out.offset = m_next;
+			out.raw_offset = header.raw_offset;
+			out.time = header.time;
+			out.flags = header.flags;
+			out.raw_size = header.raw_size;
+			out.stored_size = header.stored_size;
+			out.checksum = header.checksum;
+
+			m_next += sizeof(header) + header.stored_size;
+			return true;
+		}
+
+		bool reader::read(const frame& info, std::string& text)
+		{
+			if (!m_valid || fseek(m_file, (long)(info.offset + sizeof(frame_header)), SEEK_SET))
+				return false;
+
+			std::string data(info.stored_size, '\0');
+			if (!data.empty() && fread(&data[0], data.size(), 1, m_file) != 1)
+				return false;
+
+			if (info.flags == stored)
+				text.swap(data);
+			else
+			{
+				text.resize(info.raw_size);
+				if (!lz4::decompress(data.data(), data.size(), &text[0], text.size()))
+					return false;
+			}
+
+			return text.size() == info.raw_size && checksum(text.data(), text.size()) == info.checksum;
+		}
+	}
+
+	compressed_logger::compressed_logger(const compressed_log_config& config)
+		: m_config(config)
+	{
+		if (!open())
+			return;
+
+		m_pending.reserve(m_config.frame_size);
+		m_spare.reserve(m_config.frame_size);
+		m_thread = std::thread([this] { run(); });
+	}
+
+	compressed_logger::~compressed_logger()
+	{
+		if (m_thread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_stop = true;
+			}
+			m_wake.notify_one();
+			m_thread.join();
+		}
+
+		if (m_fd >= 0)
+			::close(m_fd);
+	}
+
+	bool compressed_logger::open()
+	{
+		m_fd = ::open(m_config.path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+		if (m_fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(m_fd, &st))
+			st.st_size = 0;
+
+		if (!st.st_size)
+		{
+			file_header header{ compressed_log::magic, compressed_log::version };
+			m_end = sizeof(header);
+			if (write_all(m_fd, (const char*)&header, sizeof(header)))
+				return true;
+		}
+		else
+		{
+			// continue the log, behind its last whole frame
+			compressed_log::reader log{ m_config.path };
+			if (log)
+			{
+				uint64_t end = sizeof(file_header);
+				compressed_log::frame frame;
+				while (log.next(frame))
+				{
+					end = frame.offset + sizeof(frame_header) + frame.stored_size;
+					m_raw_offset = frame.raw_offset + frame.raw_size;
+				}
+
+				m_end = end;
+				if (end == (uint64_t)st.st_size || !ftruncate(m_fd, (long)end))
+					return true;
+			}
+		}
+
+		::close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	void compressed_logger::write(const char* path, int line, std::string_view text)
+	{
+		char head[24 + 256];
+		size_t length = log_time_stamp(head);
+		if (m_config.location && path)
+		{
+			auto written = snprintf(head + length, sizeof(head) - length, "%s:%d: ", path, line);
+			if (written > 0)
+				length += std::min((size_t)written, sizeof(head) - length - 1);
+		}
+
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (m_pending.size() + length + text.size() + 1 > m_config.max_buffered)
+		{
+			++m_dropped;
+			return;
+		}
+
+		m_pending_times.emplace_back(m_pending.size(), now());
+		m_pending.append(head, length);
+		m_pending.append(text.data(), text.size());
+		m_pending.push_back('\n');
+
+		if (m_pending.size() >= m_config.frame_size)
+			m_wake.notify_one();
+	}
+
+	bool compressed_logger::write_frame(const char* text, size_t size, int64_t time)
+	{
+		if (m_fd < 0)
+			return false;
+
+		m_compressed.resize(sizeof(frame_header) + lz4::bound(size));
+		auto data = &m_compressed[sizeof(frame_header)];
+
+		frame_header header{};
+		header.magic = compressed_log::frame_magic;
+		header.flags = compressed_log::lz4_block;
+		header.raw_size = (uint32_t)size;
+		header.stored_size = (uint32_t)lz4::compress(text, size, data);
+		header.checksum = checksum(text, size);
+		header.raw_offset = m_raw_offset;
+		header.time = time;
+
+		// text which does not compress is kept as it is
+		if (header.stored_size >= size)
+		{
+			header.flags = compressed_log::stored;
+			header.stored_size = (uint32_t)size;
+			memcpy(data, text, size);
+		}
+
+		memcpy(&m_compressed[0], &header, sizeof(header));
+		if (write_all(m_fd, m_compressed.data(), sizeof(header) + header.stored_size))
+		{
+			m_raw_offset += size;
+			m_end += sizeof(header) + header.stored_size;
+			return true;
+		}
+
+		// a part of the frame may be in the file; the next one must not go behind it
+		m_error = errno;
+		if (ftruncate(m_fd, (off_t)m_end))
+		{
+			::close(m_fd);
+			m_fd = -1;
+		}
+		return false;
+	}
+
+	void compressed_logger::run()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_wake.wait_for(lock, m_config.flush_interval, [this]
+			{
+				return m_stop || m_pending.size() >= m_config.frame_size || m_flush_request != m_flush_done;
+			});
+
+			// the spares are only touched here, so they can be used with the lock released
+			m_pending.swap(m_spare);
+			m_pending_times.swap(m_spare_times);
+			auto dropped = m_dropped;
+			auto lost = m_lost;
+			auto request = m_flush_request;
+			bool stop = m_stop;
+			m_dropped = 0;
+			m_lost = 0;
+			lock.unlock();
+
+			auto& batch = m_spare;
+			auto& times = m_spare_times;
+
+			// the notes go last and are not counted as lost themselves, or a file
+			// which stays broken would keep one line lost forever
+			auto text_end = batch.size();
+			if (dropped || lost)
+			{
+				std::ostringstream note;
+				if (dropped)
+					note << "(" << dropped << " lines dropped, the log could not keep up)\n";
+				if (lost)
+					note << "(" << lost << " lines lost, the log could not be written: " << strerror(m_error) << ")\n";
+				if (times.empty())
+					times.emplace_back(0, now());
+				batch.append(note.str());
+			}
+
+			// frames of up to frame_size, each ending with a whole line;
+			// a longer line gets a frame of its own
+			size_t at = 0;
+			size_t line = 0;
+			uint64_t failed = 0;
+			bool noted = true;
+			while (at < batch.size())
+			{
+				size_t size = batch.size() - at;
+				if (size > m_config.frame_size)
+				{
+					auto eol = batch.rfind('\n', at + m_config.frame_size - 1);
+					if (eol == std::string::npos || eol < at)
+						eol = batch.find('\n', at + m_config.frame_size);
+					if (eol != std::string::npos)
+						size = eol + 1 - at;
+				}
+
+				// the time of the line the frame starts with (or is in the middle of,
+				// with a '\n' in the text of a line)
+				while (line + 1 < times.size() && times[line + 1].first <= at)
+					++line;
+
+				if (!write_frame(batch.data() + at, size, times[line].second))
+				{
+					for (auto it = times.begin() + line; it != times.end() && it->first < text_end; ++it)
+						++failed;
+
+					// the notes were in the last frame, they wait for the next batch
+					noted = false;
+					break;
+				}
+				at += size;
+			}
+			batch.clear();
+			times.clear();
+
+			lock.lock();
+			m_lost += failed;
+			if (!noted)
+			{
+				m_lost += lost;
+				m_dropped += dropped;
+			}
+			m_flush_done = request;
+			m_flushed.notify_all();
+
+			if (stop && m_pending.empty())
+				return;
+		}
+	}
+
+	void compressed_logger::flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (!m_thread.joinable())
+			return;
+
+		auto request = ++m_flush_request;
+		m_wake.notify_one();
+		m_flushed.wait(lock, [this, request] { return m_flush_done >= request; });
+	}
+}
@@ -0,0 +1,996 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "pch.h"
+#include <remote/event_loop.hpp>
+#include <deque>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(SYS_io_uring_setup)
+#include <linux/io_uring.h>
+#define REMOTE_HAVE_IO_URING 1
+#endif
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+namespace remote
+{
+	namespace
+	{
+		int pidfd_open(int pid)
+		{
+#ifdef SYS_pidfd_open
+			return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+			errno = ENOSYS;
+			return -1;
+#endif
+		}
+
+		int exit_status(const siginfo_t& info)
+		{
+			if (info.si_code == CLD_EXITED)
+				return info.si_status;
+			return 128 + info.si_status;
+		}
+
+		/*
+		 * The writes of one descriptor: the one being written, and everything
+		 * which came meanwhile, which goes out as a single write after it.
+		 */
+		struct pending_write
+		{
+			std::string current;
+			size_t done = 0;
+			std::string queued;
+
+			// false, if there is nothing more to write
+			bool next()
+			{
+				current.swap(queued);
+				queued.clear();
+				done = 0;
+				return !current.empty();
+			}
+		};
+
+		class epoll_loop : public event_loop
+		{
+			enum class type { ready, read, child };
+			struct entry
+			{
+				type what;
+				int fd;
+				int pid = 0;
+				entry(type what, int fd) : what(what), fd(fd) {}
+				ready_fn ready;
+				read_fn read;
+				child_fn child;
+				size_t size = 0;
+			};
+
+			int m_epoll = -1;
+			int m_wake = -1;
+			uint64_t m_next = 1; // 0 is the eventfd of wake()
+			std::unordered_map<uint64_t, entry> m_entries;
+			std::unordered_map<int, uint64_t> m_fds;
+			std::unordered_map<int, pending_write> m_writes;
+			std::vector<char> m_buffer;
+
+			bool add(entry&& e)
+			{
+				auto id = m_next++;
+				epoll_event ev{};
+				ev.events = EPOLLIN;
+				ev.data.u64 = id;
+				++m_counters.syscalls;
+				if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, e.fd, &ev))
+					return false;
+				if (e.what != type::child)
+					m_fds[e.fd] = id;
+				m_entries.emplace(id, std::move(e));
+				return true;
+			}
+
+			void remove(uint64_t id)
+			{
+				auto it = m_entries.find(id);
+				if (it == m_entries.end())
+					return;
+				++m_counters.syscalls;
+				epoll_ctl(m_epoll, EPOLL_CTL_DEL, it->second.fd, nullptr);
+				if (it->second.what == type::child)
+					::close(it->second.fd);
+				else
+					m_fds.erase(it->second.fd);
+				m_entries.erase(it);
+			}
+
+			void flush()
+			{
+				for (auto it = m_writes.begin(); it != m_writes.end();)
+				{
+					auto& w = it->second;
+					bool keep = true;
+					while (keep)
+					{
+						++m_counters.syscalls;
+						auto ret = ::write(it->first, w.current.data() + w.done, w.current.size() - w.done);
+						if (ret < 0 && errno == EINTR)
+							continue;
+						if (ret < 0)
+						{
+							// EAGAIN: again on the next run_once(); anything else drops the writes
+							keep = errno == EAGAIN;
+							break;
+						}
+						w.done += ret;
+						if (w.done == w.current.size())
+							keep = w.next();
+						else
+							break;
+					}
+					if (keep)
+						++it;
+					else
+						it = m_writes.erase(it);
+				}
+			}
+
+			void dispatch(uint64_t id)
+			{
+				auto it = m_entries.find(id);
+				if (it == m_entries.end())
+					return;
+
+				auto& e = it->second;
+				++m_counters.events;
+				if (e.what == type::ready)
+				{
+					auto fn = e.ready;
+					fn();
+				}
+				else if (e.what == type::read)
+				{
+					if (m_buffer.size() < e.size)
+						m_buffer.resize(e.size);
+					++m_counters.syscalls;
+					auto got = ::read(e.fd, m_buffer.data(), e.size);
+					if (got < 0 && (errno == EAGAIN || errno == EINTR))
+						return;
+					auto fn = e.read;
+					if (got <= 0)
+					{
+						remove(id);
+						fn(nullptr, 0);
+					}
+					else
+						fn(m_buffer.data(), got);
+				}
+				else
+				{
+					siginfo_t info{};
+					++m_counters.syscalls;
+					int ret = waitid((idtype_t)P_PIDFD, e.fd, &info, WEXITED | WNOHANG);
+					// ECHILD: somebody else reaped it, with the status; it is gone
+					// all the same, and the pidfd would stay readable and wake every
+					// epoll_wait() from now on
+					bool lost = ret < 0 && errno == ECHILD;
+					if (!lost && (ret || !info.si_pid))
+						return;
+					auto pid = e.pid;
+					auto fn = e.child;
+					remove(id);
+					++m_counters.syscalls; // the close() of the pidfd
+					fn(pid, lost ? unknown_status : exit_status(info));
+				}
+			}
+		public:
+			epoll_loop()
+			{
+				m_epoll = epoll_create1(EPOLL_CLOEXEC);
+				m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				if (m_epoll < 0 || m_wake < 0)
+					return;
+
+				epoll_event ev{};
+				ev.events = EPOLLIN;
+				ev.data.u64 = 0;
+				epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &ev);
+			}
+
+			~epoll_loop()
+			{
+				for (auto&& pair : m_entries)
+				{
+					if (pair.second.what == type::child)
+						::close(pair.second.fd);
+				}
+				if (m_wake >= 0)
+					::close(m_wake);
+				if (m_epoll >= 0)
+					::close(m_epoll);
+			}
+
+			bool ok() const { return m_epoll >= 0 && m_wake >= 0; }
+
+			const char* name() const override { return "epoll"; }
+
+			bool watch_child(int pid, const child_fn& fn) override
+			{
+				++m_counters.syscalls;
+				int fd = pidfd_open(pid);
+				if (fd < 0)
+					return false;
+
+				entry e{ type::child, fd };
+				e.pid = pid;
+				e.child = fn;
+				if (add(std::move(e)))
+					return true;
+				::close(fd);
+				return false;
+			}
+
+			bool watch(int fd, const ready_fn& fn) override
+			{
+				entry e{ type::ready, fd };
+				e.ready = fn;
+				return add(std::move(e));
+			}
+
+			bool watch_read(int fd, size_t size, const read_fn& fn) override
+			{
+				entry e{ type::read, fd };
+				e.read = fn;
+				e.size = size ? size : 1;
+				return add(std::move(e));
+			}
+
+			void unwatch(int fd) override
+			{
+				auto it = m_fds.find(fd);
+				if (it != m_fds.end())
+					remove(it->second);
+			}
+
+			void write(int fd, std::string data) override
+			{
+				if (data.empty())
+					return;
+				auto& w = m_writes[fd];
+				if (w.current.empty())
+					w.current = std::move(data);
+				else
+					w.queued.append(data);
+			}
+
+			void wake() override
+			{
+				uint64_t one = 1;
+				while (::write(m_wake, &one, sizeof(one)) < 0 && errno == EINTR)
+					;
+			}
+
+			size_t run_once(std::chrono::milliseconds timeout) override
+			{
+				++m_counters.iterations;
+				flush();
+
+				epoll_event events[256];
+				++m_counters.syscalls;
+				int count = epoll_wait(m_epoll, events, 256, (int)timeout.count());
+				if (count <= 0)
+					return 0;
+
+				auto before = m_counters.events;
+				for (int i = 0; i < count; ++i)
+				{
+					if (events[i].data.u64)
+					{
+						dispatch(events[i].data.u64);
+						continue;
+					}
+
+					uint64_t value;
+					++m_counters.syscalls;
+					while (::read(m_wake, &value, sizeof(value)) < 0 && errno == EINTR)
+						;
+				}
+
+				// the callbacks' writes go out now, not a tick later
+				if (!m_writes.empty())
+					flush();
+				return (size_t)(m_counters.events - before);
+			}
+
+			bool writing() const override { return !m_writes.empty(); }
+		};
+
+#ifdef REMOTE_HAVE_IO_URING
+#ifndef IORING_OP_WAITID
+#define IORING_OP_WAITID 50 // Linux 6.7
+#endif
+
+		/*
+		 * The ring itself, through the bare system calls (no liburing): the
+		 * submission and completion queues mapped into our memory, so queueing
+		 * a request and collecting its result are plain memory accesses, and
+		 * io_uring_enter() both submits everything queued since the last one
+		 * and waits for the first completion.
+		 */
+		class uring_loop : public event_loop
+		{
+			enum class type { ready, read, child, child_poll, write, cancel, timeout };
+			struct op
+			{
+				type what;
+				int fd = -1;
+				int pid = 0;
+				bool cancelled = false;
+				bool multishot = false;
+				ready_fn ready;
+				read_fn read;
+				child_fn child;
+				std::unique_ptr<char[]> buffer;
+				size_t size = 0;
+				siginfo_t info{};
+			};
+
+			static constexpr uint64_t timeout_id = 0;
+			static constexpr uint64_t cancel_id = 1;
+
+			int m_ring = -1;
+			void* m_sq_map = MAP_FAILED;
+			size_t m_sq_size = 0;
+			io_uring_sqe* m_sqes = (io_uring_sqe*)MAP_FAILED;
+			size_t m_sqes_size = 0;
+			unsigned* m_sq_head = nullptr;
+			unsigned* m_sq_tail = nullptr;
+			unsigned* m_sq_array = nullptr;
+			unsigned m_sq_mask = 0;
+			unsigned m_sq_entries = 0;
+			unsigned* m_cq_head = nullptr;
+			unsigned* m_cq_tail = nullptr;
+			unsigned m_cq_mask = 0;
+			io_uring_cqe* m_cqes = nullptr;
+			unsigned m_queued = 0; // sqes not submitted yet
+
+			bool m_waitid = false;    // IORING_OP_WAITID, instead of a poll of a pidfd
+			bool m_multishot = true;  // IORING_POLL_ADD_MULTI, until the kernel says otherwise
+			bool m_timer = false;     // a timeout in the ring
+			__kernel_timespec m_timespec{};
+
+			int m_wake = -1;
+			uint64_t m_next = 2;
+			std::unordered_map<uint64_t, std::unique_ptr<op>> m_ops;
+			std::unordered_map<int, uint64_t> m_fds;
+			std::unordered_map<int, pending_write> m_writes;
+			std::vector<io_uring_cqe> m_done;
+			std::vector<std::function<bool()>> m_retry; // what found the ring full; true once done
+
+			int enter(unsigned submit, unsigned wait, unsigned flags)
+			{
+				++m_counters.syscalls;
+				return (int)syscall(SYS_io_uring_enter, m_ring, submit, wait, flags, nullptr, 0);
+			}
+
+			void submit()
+			{
+				while (m_queued)
+				{
+					int ret = enter(m_queued, 0, 0);
+					if (ret > 0)
+						m_queued -= ret;
+					else if (ret < 0 && errno == EBUSY)
+						reap();
+					else if (ret < 0 && errno != EINTR)
+						break;
+				}
+			}
+
+			// nullptr, if the ring is still full after a submit(): the entries
+			// the kernel has not taken yet must not be overwritten
+			io_uring_sqe* get(uint64_t id)
+			{
+				auto head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+				if (*m_sq_tail - head >= m_sq_entries)
+				{
+					submit();
+					head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+					if (*m_sq_tail - head >= m_sq_entries)
+						return nullptr;
+				}
+
+				auto tail = *m_sq_tail;
+				auto index = tail & m_sq_mask;
+				auto sqe = &m_sqes[index];
+				memset(sqe, 0, sizeof(*sqe));
+				sqe->user_data = id;
+				m_sq_array[index] = index;
+				__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+				++m_queued;
+				return sqe;
+			}
+
+			uint64_t add(std::unique_ptr<op>&& o)
+			{
+				auto id = m_next++;
+				m_ops.emplace(id, std::move(o));
+				return id;
+			}
+
+			bool arm(uint64_t id, op& o)
+			{
+				auto sqe = get(id);
+				if (!sqe)
+					return false;
+				switch (o.what)
+				{
+				case type::ready:
+				case type::child_poll:
+					sqe->opcode = IORING_OP_POLL_ADD;
+					sqe->fd = o.fd;
+					sqe->poll32_events = POLLIN;
+					o.multishot = o.what == type::ready && m_multishot;
+					if (o.multishot)
+						sqe->len = IORING_POLL_ADD_MULTI;
+					break;
+				case type::read:
+					sqe->opcode = IORING_OP_READ;
+					sqe->fd = o.fd;
+					sqe->addr = (uint64_t)o.buffer.get();
+					sqe->len = (unsigned)o.size;
+					sqe->off = (uint64_t)-1;
+					break;
+				case type::child:
+					sqe->opcode = IORING_OP_WAITID;
+					sqe->fd = o.pid;
+					sqe->len = P_PID;
+					sqe->file_index = WEXITED;
+					sqe->addr2 = (uint64_t)&o.info;
+					break;
+				default:
+					break;
+				}
+				return true;
+			}
+
+			// a watch which is armed again after its completion; if the ring is
+			// full, on the next run_once()
+			void rearm(uint64_t id, op& o)
+			{
+				if (arm(id, o))
+					return;
+				m_retry.push_back([this, id]
+				{
+					auto it = m_ops.find(id);
+					return it == m_ops.end() || it->second->cancelled || arm(id, *it->second);
+				});
+			}
+
+			void arm_write(int fd, pending_write& w)
+			{
+				if (queue_write(fd, w))
+					return;
+				m_retry.push_back([this, fd]
+				{
+					auto w = m_writes.find(fd);
+					return w == m_writes.end() || queue_write(fd, w->second);
+				});
+			}
+
+			bool queue_write(int fd, pending_write& w)
+			{
+				auto sqe = get(m_next);
+				if (!sqe)
+					return false;
+
+				std::unique_ptr<op> o{ new op };
+				o->what = type::write;
+				o->fd = fd;
+				add(std::move(o));
+				sqe->opcode = IORING_OP_WRITE;
+				sqe->fd = fd;
+				sqe->addr = (uint64_t)(w.current.data() + w.done);
+				sqe->len = (unsigned)std::min<size_t>(w.current.size() - w.done, 1u << 30);
+				sqe->off = (uint64_t)-1;
+				return true;
+			}
+
+			// the completions of a cancelled op are ignored from now on, whenever
+			// the kernel gets to the cancel
+			void cancel(uint64_t id, op& o)
+			{
+				o.cancelled = true;
+				if (queue_cancel(id, o))
+					return;
+				m_retry.push_back([this, id]
+				{
+					auto it = m_ops.find(id);
+					return it == m_ops.end() || queue_cancel(id, *it->second);
+				});
+			}
+
+			bool queue_cancel(uint64_t id, op& o)
+			{
+				auto sqe = get(cancel_id);
+				if (!sqe)
+					return false;
+				sqe->opcode = o.what == type::ready || o.what == type::child_poll ? IORING_OP_POLL_REMOVE : IORING_OP_ASYNC_CANCEL;
+				sqe->fd = -1;
+				sqe->addr = id;
+				return true;
+			}
+
+			// takes the completions out of the ring, before any callback can queue more
+			void reap()
+			{
+				auto head = *m_cq_head;
+				auto tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+				for (; head != tail; ++head)
+					m_done.push_back(m_cqes[head & m_cq_mask]);
+				__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+			}
+
+			void complete(const io_uring_cqe& cqe)
+			{
+				if (cqe.user_data == timeout_id)
+				{
+					m_timer = false;
+					return;
+				}
+				if (cqe.user_data == cancel_id)
+					return;
+
+				auto it = m_ops.find(cqe.user_data);
+				if (it == m_ops.end())
+					return;
+
+				auto id = it->first;
+				auto& o = *it->second;
+				bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+				if (o.cancelled)
+				{
+					if (!more)
+						m_ops.erase(it);
+					return;
+				}
+
+				switch (o.what)
+				{
+				case type::ready:
+				{
+					if (cqe.res == -EINVAL && o.multishot)
+					{
+						m_multishot = false;
+						rearm(id, o);
+						return;
+					}
+					if (!more)
+						rearm(id, o);
+					if (cqe.res < 0)
+						return;
+					++m_counters.events;
+					auto fn = o.ready;
+					fn();
+					return;
+				}
+				case type::read:
+				{
+					if (cqe.res == -EAGAIN || cqe.res == -EINTR)
+					{
+						rearm(id, o);
+						return;
+					}
+					if (o.fd != m_wake)
+						++m_counters.events;
+					auto fn = o.read;
+					if (cqe.res <= 0)
+					{
+						m_fds.erase(o.fd);
+						m_ops.erase(it);
+						fn(nullptr, 0);
+						return;
+					}
+					rearm(id, o);
+					fn(o.buffer.get(), cqe.res);
+					return;
+				}
+				case type::child:
+				{
+					if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+					{
+						rearm(id, o);
+						return;
+					}
+					auto pid = o.pid;
+					auto fn = o.child;
+					auto info = o.info;
+					m_ops.erase(it);
+					// ECHILD: somebody else reaped it, with the status
+					++m_counters.events;
+					fn(pid, cqe.res < 0 ? unknown_status : exit_status(info));
+					return;
+				}
+				case type::child_poll:
+				{
+					siginfo_t info{};
+					++m_counters.syscalls;
+					int ret = waitid((idtype_t)P_PIDFD, o.fd, &info, WEXITED | WNOHANG);
+					if ((ret < 0 && errno != ECHILD) || (!ret && !info.si_pid))
+					{
+						rearm(id, o);
+						return;
+					}
+					auto pid = o.pid;
+					auto fn = o.child;
+					++m_counters.syscalls;
+					::close(o.fd);
+					m_ops.erase(it);
+					++m_counters.events;
+					fn(pid, info.si_pid ? exit_status(info) : unknown_status);
+					return;
+				}
+				case type::write:
+				{
+					auto fd = o.fd;
+					m_ops.erase(it);
+					auto w = m_writes.find(fd);
+					if (w == m_writes.end())
+						return;
+					if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+						arm_write(fd, w->second);
+					else if (cqe.res < 0)
+						m_writes.erase(w);
+					else
+					{
+						w->second.done += cqe.res;
+						if (w->second.done < w->second.current.size() || w->second.next())
+							arm_write(fd, w->second);
+						else
+							m_writes.erase(w);
+					}
+					return;
+				}
+				default:
+					return;
+				}
+			}
+
+			bool probe()
+			{
+				size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+				std::unique_ptr<char[]> buffer{ new char[size]() };
+				auto p = (io_uring_probe*)buffer.get();
+				if (syscall(SYS_io_uring_register, m_ring, IORING_REGISTER_PROBE, p, 256) < 0)
+					return false;
+				return p->last_op >= IORING_OP_WAITID && (p->ops[IORING_OP_WAITID].flags & IO_URING_OP_SUPPORTED);
+			}
+		public:
+			uring_loop()
+			{
+				io_uring_params params{};
+				params.flags = IORING_SETUP_CQSIZE;
+				params.cq_entries = 4096;
+				m_ring = (int)syscall(SYS_io_uring_setup, 256, &params);
+				if (m_ring < 0)
+					return;
+
+				// single mmap (5.4), no dropped completions (5.5), writes at the file position (5.6)
+				const unsigned wanted = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+				if ((params.features & wanted) != wanted)
+				{
+					::close(m_ring);
+					m_ring = -1;
+					return;
+				}
+
+				m_sq_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+					params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+				m_sq_map = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+				m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+				m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+				if (m_sq_map == MAP_FAILED || m_sqes == MAP_FAILED)
+				{
+					::close(m_ring);
+					m_ring = -1;
+					return;
+				}
+
+				auto base = (char*)m_sq_map;
+				m_sq_head = (unsigned*)(base + params.sq_off.head);
+				m_sq_tail = (unsigned*)(base + params.sq_off.tail);
+				m_sq_mask = *(unsigned*)(base + params.sq_off.ring_mask);
+				m_sq_entries = *(unsigned*)(base + params.sq_off.ring_entries);
+				m_sq_array = (unsigned*)(base + params.sq_off.array);
+				m_cq_head = (unsigned*)(base + params.cq_off.head);
+				m_cq_tail = (unsigned*)(base + params.cq_off.tail);
+				m_cq_mask = *(unsigned*)(base + params.cq_off.ring_mask);
+				m_cqes = (io_uring_cqe*)(base + params.cq_off.cqes);
+
+				m_waitid = probe();
+
+				m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				if (m_wake < 0)
+					return;
+				watch_read(m_wake, sizeof(uint64_t), [](const char*, size_t) {});
+			}
+
+			~uring_loop()
+			{
+				// closing the ring cancels whatever is still in it
+				if (m_ring >= 0)
+					::close(m_ring);
+				if (m_sqes != MAP_FAILED)
+					munmap(m_sqes, m_sqes_size);
+				if (m_sq_map != MAP_FAILED)
+					munmap(m_sq_map, m_sq_size);
+				for (auto&& pair : m_ops)
+				{
+					if (pair.second->what == type::child_poll)
+						::close(pair.second->fd);
+				}
+				if (m_wake >= 0)
+					::close(m_wake);
+			}
+
+			bool ok() const { return m_ring >= 0 && m_wake >= 0; }
+
+			const char* name() const override { return "io_uring"; }
+
+			bool watch_child(int pid, const child_fn& fn) override
+			{
+				std::unique_ptr<op> o{ new op };
+				o->pid = pid;
+				o->child = fn;
+				if (m_waitid)
+					o->what = type::child;
+				else
+				{
+					// before 6.7: a poll of a pidfd, and the waitid() when it fires
+					++m_counters.syscalls;
+					o->what = type::child_poll;
+					o->fd = pidfd_open(pid);
+					if (o->fd < 0)
+						return false;
+				}
+
+				auto& ref = *o;
+				auto id = add(std::move(o));
+				if (arm(id, ref))
+					return true;
+				if (ref.what == type::child_poll)
+					::close(ref.fd);
+				m_ops.erase(id);
+				return false;
+			}
+
+			bool watch(int fd, const ready_fn& fn) override
+			{
+				if (m_fds.count(fd))
+					return false;
+				std::unique_ptr<op> o{ new op };
+				o->what = type::ready;
+				o->fd = fd;
+				o->ready = fn;
+				auto& ref = *o;
+				auto id = add(std::move(o));
+				if (!arm(id, ref))
+				{
+					m_ops.erase(id);
+					return false;
+				}
+				m_fds[fd] = id;
+				return true;
+			}
+
+			bool watch_read(int fd, size_t size, const read_fn& fn) override
+			{
+				if (m_fds.count(fd))
+					return false;
+				std::unique_ptr<op> o{ new op };
+				o->what = type::read;
+				o->fd = fd;
+				o->read = fn;
+				o->size = size ? size : 1;
+				o->buffer.reset(new char[o->size]);
+				auto& ref = *o;
+				auto id = add(std::move(o));
+				if (!arm(id, ref))
+				{
+					m_ops.erase(id);
+					return false;
+				}
+				m_fds[fd] = id;
+				return true;
+			}
+
+			void unwatch(int fd) override
+			{
+				auto it = m_fds.find(fd);
+				if (it == m_fds.end())
+					return;
+				auto op = m_ops.find(it->second);
+				if (op != m_ops.end())
+					cancel(op->first, *op->second);
+				m_fds.erase(it);
+			}
+
+			void write(int fd, std::string data) override
+			{
+				if (data.empty())
+					return;
+				auto& w = m_writes[fd];
+				if (!w.current.empty())
+				{
+					w.queued.append(data);
+					return;
+				}
+				w.current = std::move(data);
+				arm_write(fd, w);
+			}
+
+			void wake() override
+			{
+				uint64_t one = 1;
+				while (::write(m_wake, &one, sizeof(one)) < 0 && errno == EINTR)
+					;
+			}
+
+			size_t run_once(std::chrono::milliseconds timeout) override
+			{
+				++m_counters.iterations;
+				auto before = m_counters.events;
+
+				reap();
+				if (!m_retry.empty())
+				{
+					auto retry = std::move(m_retry);
+					m_retry.clear();
+					for (auto&& fn : retry)
+					{
+						if (!fn())
+							m_retry.push_back(std::move(fn));
+					}
+				}
+				if (m_done.empty() && timeout.count() > 0)
+				{
+					// completes after the timeout, or with the first completion of anything else
+					if (!m_timer)
+					{
+						m_timespec.tv_sec = timeout.count() / 1000;
+						m_timespec.tv_nsec = (timeout.count() % 1000) * 1000000;
+						auto sqe = get(timeout_id);
+						if (sqe)
+						{
+							sqe->opcode = IORING_OP_TIMEOUT;
+							sqe->addr = (uint64_t)&m_timespec;
+							sqe->len = 1;
+							sqe->off = 1;
+							m_timer = true;
+						}
+					}
+
+					// without a timer in the ring, this would wait for good
+					int ret = m_timer ? enter(m_queued, 1, IORING_ENTER_GETEVENTS) : 0;
+					if (ret > 0)
+						m_queued -= std::min<unsigned>(ret, m_queued);
+					else if (!m_timer || (ret < 0 && errno == EBUSY))
+						submit();
+				}
+				else
+					submit();
+
+				// the callbacks queue more; those go out with the next enter()
+				for (;;)
+				{
+					reap();
+					if (m_done.empty())
+						break;
+					auto done = std::move(m_done);
+					m_done.clear();
+					for (auto&& cqe : done)
+						complete(cqe);
+				}
+				return (size_t)(m_counters.events - before);
+			}
+
+			bool writing() const override { return !m_writes.empty(); }
+		};
+#endif // REMOTE_HAVE_IO_URING
+	}
+
+	event_loop::~event_loop()
+	{
+		for (auto fd : m_owned)
+			::close(fd);
+	}
+
+	bool event_loop::watch_signals(const std::vector<int>& sigs, const signal_info_t& fn)
+	{
+		sigset_t set;
+		sigemptyset(&set);
+		for (auto sig : sigs)
+			sigaddset(&set, sig);
+
+		int fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (fd < 0)
+			return false;
+
+		bool ok = watch_read(fd, 16 * sizeof(signalfd_siginfo), [fn](const char* data, size_t size) {
+			for (size_t at = 0; at + sizeof(signalfd_siginfo) <= size; at += sizeof(signalfd_siginfo))
+			{
+				signalfd_siginfo si;
+				memcpy(&si, data + at, sizeof(si));
+
+				signal_info info;
+				info.signal = (int)si.ssi_signo;
+				info.sender = (int)si.ssi_pid;
+				info.value = si.ssi_int;
+				info.queued = si.ssi_code == SI_QUEUE;
+				fn(info);
+			}
+		});
+
+		if (!ok)
+		{
+			::close(fd);
+			return false;
+		}
+		m_owned.push_back(fd);
+		return true;
+	}
+
+	std::unique_ptr<event_loop> event_loop::create(kind which)
+	{
+#ifdef REMOTE_HAVE_IO_URING
+		if (which != kind::epoll)
+		{
+			std::unique_ptr<uring_loop> loop{ new uring_loop };
+			if (loop->ok())
+				return loop;
+			if (which == kind::io_uring)
+				return nullptr;
+		}
+#else
+		if (which == kind::io_uring)
+			return nullptr;
+#endif
+
+		std::unique_ptr<epoll_loop> loop{ new epoll_loop };
+		if (!loop->ok())
+			return nullptr;
+		return loop;
+	}
+}
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/file_logger.hpp>
+
+#ifdef _WIN32
+#define O_CLOEXEC 0
+#else
+#include <sys/uio.h>
+#include <limits.h>
+#endif
+
+namespace remote
+{
+	namespace
+	{
+		constexpr size_t chunk_size = 64 * 1024;
+		constexpr size_t spare_chunks = 64;
+
+		size_t lines_in(const char* data, size_t size)
+		{
+			return (size_t)std::count(data, data + size, '\n');
+		}
+	}
+
+	file_logger::file_logger(const file_log_config& config)
+		: m_config(config)
+	{
+		if (!open())
+			return;
+
+		m_thread = std::thread([this] { run(); });
+	}
+
+	file_logger::~file_logger()
+	{
+		if (m_signals && m_token)
+			m_signals->unsubscribe(m_token);
+
+		if (m_thread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> guard(m_mutex);
+				m_stop = true;
+			}
+			m_wake.notify_one();
+			m_thread.join();
+		}
+
+		if (m_fd >= 0)
+			::close(m_fd);
+	}
+
+	bool file_logger::open()
+	{
+		m_fd = ::open(m_config.path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+		if (m_fd < 0)
+		{
+			m_error = errno;
+			return false;
+		}
+
+		struct stat st;
+		m_size = fstat(m_fd, &st) ? 0 : (size_t)st.st_size;
+		return true;
+	}
+
+	void file_logger::rotate()
+	{
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_fd = -1;
+
+		if (!m_config.keep)
+			remove(m_config.path.c_str());
+
+		for (unsigned i = m_config.keep; i > 0; --i)
+		{
+			std::ostringstream from, to;
+			if (i > 1)
+				from << m_config.path << '.' << (i - 1);
+			else
+				from << m_config.path;
+			to << m_config.path << '.' << i;
+
+			// rename() does not replace an existing file everywhere
+			remove(to.str().c_str());
+			rename(from.str().c_str(), to.str().c_str());
+		}
+
+		open();
+	}
+
+	void file_logger::write(const char* path, int line, std::string_view text)
+	{
+		char head[24 + 256];
+		size_t length = log_time_stamp(head);
+		if (m_config.location && path)
+		{
+			auto written = snprintf(head + length, sizeof(head) - length, "%s:%d: ", path, line);
+			if (written > 0)
+				length += std::min((size_t)written, sizeof(head) - length - 1);
+		}
+
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (m_buffered + length + text.size() + 1 > m_config.max_buffered)
+		{
+			++m_dropped;
+			return;
+		}
+
+		append({ head, length });
+		append(text);
+		append("\n");
+		m_buffered += length + text.size() + 1;
+
+		if (m_buffered >= m_config.batch_size)
+			m_wake.notify_one();
+	}
+
+	// under the lock
+	void file_logger::append(std::string_view text)
+	{
+		while (!text.empty())
+		{
+			if (m_pending.empty() || m_pending.back().size() == chunk_size)
+			{
+				if (m_spare.empty())
+				{
+					m_pending.emplace_back();
+					m_pending.back().reserve(chunk_size);
+				}
+				else
+				{
+					m_pending.push_back(std::move(m_spare.back()));
+					m_spare.pop_back();
+				}
+			}
+
+			auto& last = m_pending.back();
+			auto part = std::min(text.size(), chunk_size - last.size());
+			last.append(text.data(), part);
+			text.remove_prefix(part);
+		}
+	}
+
+	size_t file_logger::write_out(std::vector<chunk>& chunks)
+	{
+		size_t total = 0;
+		for (auto&& c : chunks)
+			total += c.size();
+		if (!total)
+			return 0;
+
+		if (m_config.rotate_size && m_size && m_size + total > m_config.rotate_size)
+			rotate();
+
+		size_t lost = 0;
+		if (m_fd < 0)
+		{
+			for (auto&& c : chunks)
+				lost += lines_in(c.data(), c.size());
+			return lost;
+		}
+
+#ifdef _WIN32
+		for (auto&& c : chunks)
+		{
+			if (_write(m_fd, c.data(), (unsigned)c.size()) > 0)
+				m_size += c.size();
+			else
+			{
+				m_error = errno;
+				lost += lines_in(c.data(), c.size());
+			}
+		}
+#else
+		std::vector<iovec> io;
+		io.reserve(chunks.size());
+		for (auto&& c : chunks)
+		{
+			if (!c.empty())
+				io.push_back(iovec{ (void*)c.data(), c.size() });
+		}
+
+		size_t first = 0;
+		while (first < io.size())
+		{
+			auto count = std::min(io.size() - first, (size_t)IOV_MAX);
+			auto written = ::writev(m_fd, io.data() + first, (int)count);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				// e.g. ENOSPC; the rest of the batch is gone, but not without a trace
+				m_error = errno;
+				for (; first < io.size(); ++first)
+					lost += lines_in((const char*)io[first].iov_base, io[first].iov_len);
+				break;
+			}
+
+			m_size += (size_t)written;
+
+			// a short write leaves the rest of the batch in place
+			while (written > 0 && first < io.size())
+			{
+				if ((size_t)written >= io[first].iov_len)
+				{
+					written -= io[first].iov_len;
+					++first;
+					continue;
+				}
+				io[first].iov_base = (char*)io[first].iov_base + written;
+				io[first].iov_len -= written;
+				written = 0;
+			}
+		}
+#endif
+		return lost;
+	}
+
+	void file_logger::run()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_wake.wait_for(lock, m_config.flush_interval, [this]
+			{
+				return m_stop || m_reopen || m_buffered >= m_config.batch_size || m_flush_request != m_flush_done;
+			});
+
+			std::vector<chunk> batch;
+			batch.swap(m_pending);
+			auto dropped = m_dropped;
+			auto lost = m_lost;
+			auto request = m_flush_request;
+			bool stop = m_stop;
+			m_dropped = 0;
+			m_lost = 0;
+			m_buffered = 0;
+			lock.unlock();
+
+			if (m_reopen.exchange(false))
+			{
+				if (m_fd >= 0)
+					::close(m_fd);
+				open();
+			}
+
+			size_t notes = 0;
+			if (dropped)
+			{
+				++notes;
+				std::ostringstream note;
+				note << "(" << dropped << " lines dropped, the log could not keep up)\n";
+				batch.push_back(note.str());
+			}
+
+			if (lost)
+			{
+				++notes;
+				std::ostringstream note;
+				note << "(" << lost << " lines lost, the log could not be written: " << strerror(m_error) << ")\n";
+				batch.push_back(note.str());
+			}
+
+			// the notes are last: what could not be written is counted without them,
+			// or a file which stays broken would keep one line lost forever
+			lost = write_out(batch);
+			lost -= std::min<size_t>(lost, notes);
+
+			lock.lock();
+			m_lost += lost;
+			for (auto&& c : batch)
+			{
+				if (m_spare.size() >= spare_chunks || c.capacity() < chunk_size)
+					continue;
+				c.clear();
+				m_spare.push_back(std::move(c));
+			}
+
+			m_flush_done = request;
+			m_flushed.notify_all();
+
+			if (stop && m_pending.empty())
+				return;
+		}
+	}
+
+	bool file_logger::reopen_on(signals& sig, const char* name)
+	{
+		if (m_signals && m_token)
+			m_signals->unsubscribe(m_token);
+
+		m_signals = &sig;
+		m_token = sig.subscribe(name, [this] { reopen(); });
+		return !!m_token;
+	}
+
+	void file_logger::reopen()
+	{
+		m_reopen = true;
+		m_wake.notify_one();
+	}
+
+	void file_logger::flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (!m_thread.joinable())
+			return;
+
+		auto request = ++m_flush_request;
+		m_wake.notify_one();
+		m_flushed.wait(lock, [this, request] { return m_flush_done >= request; });
+	}
+}
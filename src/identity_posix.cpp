@@ -39,6 +39,8 @@ namespace remote
 {
 	namespace posix
 	{
+		enum : size_t { max_buffer = 1024 * 1024 };
+
 		template <typename Final>
 		struct id_data
 		{
@@ -49,27 +51,39 @@ namespace remote
 				item_t item;
 				item_t *result = nullptr;
 
-				size_t bufsize = sysconf(Final::size_max);
-				if (bufsize == -1)          /* Value was indeterminate */
-					bufsize = 16384;        /* Should be more than enough */
-
-				char* buffer = new (std::nothrow) char[bufsize];
-				if (!buffer)
-					return Final(identity::oom);
+				long hint = sysconf(Final::size_max);
+				size_t bufsize = hint > 0 ? (size_t)hint : 1024;
 
-				int s = reader(&item, buffer, bufsize, &result);
-				if (result)
+				// the hint from sysconf is only a hint, entries with long member
+				// lists (or directory services) need more; grow until it fits
+				std::vector<char> buffer;
+				int s = 0;
+				for (;;)
 				{
-					Final out{ item };
-					delete [] buffer;
-					return out;
+					try
+					{
+						buffer.resize(bufsize);
+					}
+					catch (std::bad_alloc&)
+					{
+						return Final(identity::oom);
+					}
+
+					s = reader(&item, buffer.data(), bufsize, &result);
+					if (s != ERANGE || bufsize >= max_buffer)
+						break;
+
+					bufsize *= 2;
 				}
 
-				delete [] buffer;
+				if (result)
+					return Final{ item };
+
 				if (!s)
 					return Final(identity::name_unknown);
+				if (s == ERANGE)
+					return Final(identity::oom);
 				return Final(identity::no_access);
-
 			}
 		};
 
@@ -228,6 +242,8 @@ namespace remote
 		};
 	}
 
+#define RETURN_IF_ERROR(expr) do { identity ret = (expr); if (ret != identity::ok) return ret; } while(0)
+
 	identity get_uid(const char* name, uid_t& uid, gid_t& gid)
 	{
 		auto usr = posix::user::from_name(name);
@@ -280,7 +296,75 @@ namespace remote
 		return identity::ok;
 	}
 
-#define RETURN_IF_ERROR(expr) do { identity ret = (expr); if (ret != identity::ok) return ret; } while(0)
+	identity get_groups(const char* name, gid_t gid, std::vector<unsigned int>& out)
+	{
+		static_assert(sizeof(gid_t) == sizeof(unsigned int), "credentials::groups is handed to setgroups as-is");
+
+		int count = 32;
+		for (;;)
+		{
+			try
+			{
+				out.resize(count);
+			}
+			catch (std::bad_alloc&)
+			{
+				return identity::oom;
+			}
+
+			int found = count;
+			if (getgrouplist(name, gid, (gid_t*)out.data(), &found) != -1)
+			{
+				out.resize(found);
+				return identity::ok;
+			}
+
+			count = found > count ? found : count * 2;
+		}
+	}
+
+	namespace
+	{
+		std::mutex s_cache_mutex;
+		std::map<std::pair<std::string, std::string>, credentials> s_cache;
+	}
+
+	identity resolve_identity(const char* uname, const char* gname, credentials& out)
+	{
+		auto key = std::make_pair(NULLOR(uname), NULLOR(gname));
+
+		std::lock_guard<std::mutex> guard(s_cache_mutex);
+		auto it = s_cache.find(key);
+		if (it != s_cache.end())
+		{
+			out = it->second;
+			return identity::ok;
+		}
+
+		// a failure is not kept: the user may be added, or the lookup
+		// (NSS, LDAP) may have failed only this once
+		credentials creds;
+		uid_t uid = 0;
+		gid_t gid = 0;
+
+		RETURN_IF_ERROR(get_uid(uname, uid, gid));
+
+		if (gname && *gname)
+			RETURN_IF_ERROR(get_gid(gname, gid));
+
+		RETURN_IF_ERROR(get_groups(uname, gid, creds.groups));
+
+		creds.uid = uid;
+		creds.gid = gid;
+		out = s_cache[key] = creds;
+		return identity::ok;
+	}
+
+	void forget_identities()
+	{
+		std::lock_guard<std::mutex> guard(s_cache_mutex);
+		s_cache.clear();
+	}
 
 	static inline identity proxy(int val, const char* name)
 	{
@@ -292,9 +376,13 @@ namespace remote
 	}
 	identity change_identity(const char* uname, const char* gname)
 	{
-		uid_t uid = 0;
-		gid_t gid = 0;
+		credentials creds;
+		RETURN_IF_ERROR(resolve_identity(uname, gname, creds));
+		return change_identity(creds);
+	}
 
+	identity change_identity(const credentials& creds)
+	{
 #ifdef DEBUG_IDENT
 		auto test_uid = getuid();
 		auto test_gid = getgid();
@@ -303,13 +391,13 @@ namespace remote
 		std::cerr << "\nBefore: real: " << test_uid << "/" << test_gid << "; effective: " << test_euid << "/" << test_egid << std::endl;
 #endif
 
-		RETURN_IF_ERROR(get_uid(uname, uid, gid));
-
-		if (gname && *gname)
-			RETURN_IF_ERROR(get_gid(gname, gid));
+		// only root may change the supplementary groups; anybody else
+		// can still "change" to the identity they already have
+		if (!geteuid())
+			RETURN_IF_ERROR(proxy(setgroups(creds.groups.size(), (const gid_t*)creds.groups.data()), "setgroups"));
 
-		RETURN_IF_ERROR(proxy(setgid(gid), "setgid"));
-		RETURN_IF_ERROR(proxy(setuid(uid), "setuid"));
+		RETURN_IF_ERROR(proxy(setgid(creds.gid), "setgid"));
+		RETURN_IF_ERROR(proxy(setuid(creds.uid), "setuid"));
 
 #ifdef DEBUG_IDENT
 		test_uid = getuid();
@@ -27,7 +27,22 @@
 
 namespace remote
 {
-	identity change_identity(const char* uname, const char* gname)
+	identity resolve_identity(const char*, const char*, credentials& out)
+	{
+		out = credentials{};
+		return identity::ok;
+	}
+
+	void forget_identities()
+	{
+	}
+
+	identity change_identity(const char*, const char*)
+	{
+		return identity::ok;
+	}
+
+	identity change_identity(const credentials&)
 	{
 		return identity::ok;
 	}
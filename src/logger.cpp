@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/logger.hpp>
+#include <chrono>
+#include <ctime>
+
+namespace remote
+{
+	namespace
+	{
+		std::atomic<log_limit*> s_limits{ nullptr };
+
+		int64_t now()
+		{
+			using namespace std::chrono;
+			return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+		}
+
+		// xorshift64*, one per thread; good enough to pick the lines
+		uint64_t random()
+		{
+			static thread_local uint64_t state = 0;
+			if (!state)
+				state = ((uint64_t)now() ^ (uint64_t)(uintptr_t)&state) | 1;
+
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			return state * 0x2545F4914F6CDD1DULL;
+		}
+
+		void hold_back(log_limit& limit)
+		{
+			limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+
+			bool listed = false;
+			if (limit.listed.load(std::memory_order_relaxed) || !limit.listed.compare_exchange_strong(listed, true))
+				return;
+
+			// sites are static and never leave the list
+			auto head = s_limits.load(std::memory_order_relaxed);
+			do
+			{
+				limit.next = head;
+			} while (!s_limits.compare_exchange_weak(head, &limit, std::memory_order_release, std::memory_order_relaxed));
+		}
+	}
+
+	bool log_limit::pass(double per_second, unsigned burst)
+	{
+		if (per_second <= 0)
+		{
+			hold_back(*this);
+			return false;
+		}
+
+		auto interval = (int64_t)(1e9 / per_second);
+		auto tolerance = interval * (int64_t)(burst ? burst - 1 : 0);
+		auto at = now();
+
+		auto expected = tat.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			auto start = expected > at ? expected : at;
+			if (start - at > tolerance)
+			{
+				hold_back(*this);
+				return false;
+			}
+
+			if (tat.compare_exchange_weak(expected, start + interval, std::memory_order_relaxed))
+				return true;
+		}
+	}
+
+	bool log_limit::sample(unsigned one_in)
+	{
+		if (one_in <= 1 || !(random() % one_in))
+			return true;
+
+		hold_back(*this);
+		return false;
+	}
+
+	void log_suppressed(const logger_ptr& log)
+	{
+		for (auto limit = s_limits.load(std::memory_order_acquire); limit; limit = limit->next)
+		{
+			if (!limit->suppressed.load(std::memory_order_relaxed))
+				continue;
+
+			auto count = limit->suppressed.exchange(0, std::memory_order_relaxed);
+			if (count)
+				LOG_AT(log, limit->site) << '(' << count << " similar lines suppressed)";
+		}
+	}
+
+	// the part up to the seconds is formatted once a second per thread
+	size_t log_time_stamp(char* out)
+	{
+		struct cache
+		{
+			time_t second = -1;
+			char text[24];
+		};
+		static thread_local cache last;
+
+		using namespace std::chrono;
+		auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+		time_t second = (time_t)(now / 1000);
+		if (second != last.second)
+		{
+			tm local;
+#ifdef _WIN32
+			localtime_s(&local, &second);
+#else
+			localtime_r(&second, &local);
+#endif
+			strftime(last.text, sizeof(last.text), "%Y-%m-%d %H:%M:%S", &local);
+			last.second = second;
+		}
+
+		auto ms = (unsigned)(now % 1000);
+		memcpy(out, last.text, 19);
+		out[19] = '.';
+		out[20] = (char)('0' + ms / 100);
+		out[21] = (char)('0' + ms / 10 % 10);
+		out[22] = (char)('0' + ms % 10);
+		out[23] = ' ';
+		return 24;
+	}
+}
@@ -25,6 +25,10 @@
 #include "pch.h"
 #include <remote/pid.hpp>
 
+#ifndef _WIN32
+#include <sys/file.h>
+#endif
+
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable: 4996) // The POSIX name for this item is deprecated. Instead, use the ISO C++ conformant name
@@ -89,55 +93,175 @@ namespace remote
 		explicit operator bool() const { return fd >= 0; }
 		size_t read(void* ptr, size_t len) const { return ::read(fd, ptr, len); }
 		size_t write(const void* ptr, size_t len) const { return ::write(fd, ptr, len); }
+		int release() { auto tmp = fd; fd = -1; return tmp; }
 	};
 
+	namespace
+	{
+#ifdef _WIN32
+		// the lock is the file itself: it stays open without FILE_SHARE_WRITE
+		int open_locked(const std::string& path, bool create)
+		{
+			HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+				nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				if (GetLastError() == ERROR_SHARING_VIOLATION)
+					errno = EWOULDBLOCK;
+				return -1;
+			}
+			return _open_osfhandle((intptr_t)file, 0);
+		}
+
+		bool probe_lock(const std::string& path)
+		{
+			HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return GetLastError() == ERROR_SHARING_VIOLATION;
+			CloseHandle(file);
+			return false;
+		}
+#else
+		bool lock(int fd, int op)
+		{
+			int ret;
+			do
+			{
+				ret = flock(fd, op | LOCK_NB);
+			} while (ret && errno == EINTR);
+			return !ret;
+		}
+
+		bool same_file(int fd, const std::string& path)
+		{
+			struct stat by_fd, by_path;
+			return !fstat(fd, &by_fd) && !stat(path.c_str(), &by_path)
+				&& by_fd.st_dev == by_path.st_dev && by_fd.st_ino == by_path.st_ino;
+		}
+
+		/*
+		 * Whoever holds the lock on the inode currently under the path owns
+		 * it. The new file is written and locked under a temporary name and
+		 * renamed over the old one, so readers never see it half-written.
+		 */
+		int open_locked(const std::string& path, const char* content, size_t length)
+		{
+			for (;;)
+			{
+				FD current{ open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644) };
+				if (!current)
+					return -1;
+
+				if (!lock(current.fd, LOCK_EX))
+					return -1;
+
+				// somebody renamed a new file in, while we waited for this one
+				if (!same_file(current.fd, path))
+					continue;
+
+				char suffix[SIZE];
+				itoa(_getpid(), suffix, SIZE);
+				auto temp = path + ".tmp." + suffix;
+
+				FD fd{ open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+				if (!fd || !lock(fd.fd, LOCK_EX) || fd.write(content, length) != length || rename(temp.c_str(), path.c_str()))
+				{
+					int err = errno;
+					unlink(temp.c_str());
+					errno = err;
+					return -1;
+				}
+
+				return fd.release();
+			}
+		}
+
+		bool probe_lock(const std::string& path)
+		{
+			FD fd{ open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+			if (!fd)
+				return false;
+
+			// a shared lock is only refused, if the owner still holds its exclusive one
+			return !lock(fd.fd, LOCK_SH) && errno == EWOULDBLOCK;
+		}
+#endif
+	}
+
 	pid::pid(const std::string& path) : m_path{ path }
 	{
-		FD fd{ open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644) };
+		char buffer[SIZE];
+		itoa(_getpid(), buffer, SIZE);
+
+#ifdef _WIN32
+		FD fd{ open_locked(path, true) };
+		if (fd)
+			fd.write(buffer, strlen(buffer));
+#else
+		FD fd{ open_locked(path, buffer, strlen(buffer)) };
+#endif
 		if (!fd)
 		{
 			int err = errno;
 			switch (err)
 			{
-			case EEXIST:
+			case EWOULDBLOCK:
 				throw std::runtime_error("PID file already exists.");
 			}
 			throw std::runtime_error("Cannot open PID file.");
 		}
 
-		char buffer[SIZE];
-		itoa(_getpid(), buffer, SIZE);
-
-		fd.write(buffer, strlen(buffer));
+		m_fd = fd.release();
 	}
 
 	pid::~pid()
 	{
+		// removed while still locked, so nobody can take over a file
+		// which is about to disappear
 		std::remove(m_path.c_str());
+		if (m_fd != -1)
+			close(m_fd);
+	}
+
+	bool pid::is_running(const std::string& path)
+	{
+		return probe_lock(path);
 	}
 
 	bool pid::read(const std::string& path, int& _pid)
 	{
 		FD fd{ open(path.c_str(), O_RDONLY) };
 		if (!fd)
-		{
-			int err = errno;
 			return false;
+
+		// one byte more than any pid needs, to tell a too-long file apart
+		char buffer[SIZE + 1];
+		size_t size = 0;
+		for (;;)
+		{
+			auto ret = fd.read(buffer + size, sizeof(buffer) - size);
+			if (ret == (size_t)-1)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			if (!ret)
+				break;
+			size += ret;
+			if (size == sizeof(buffer))
+				return false;
 		}
 
-		struct stat st;
-		if (stat(path.c_str(), &st))
-			return false;
+		while (size && (buffer[size - 1] == '\n' || buffer[size - 1] == '\r'))
+			--size;
 
-		auto size = st.st_size;
-		if (size > SIZE)
+		if (!size)
 			return false;
 
-		char buffer[SIZE];
-		auto ret = fd.read(buffer, size);
-
 		_pid = 0;
-		for (size_t i = 0; i < ret; ++i)
+		for (size_t i = 0; i < size; ++i)
 		{
 			switch (buffer[i])
 			{
@@ -62,14 +62,33 @@ namespace remote
 		}
 	};
 
-	void check_if_used(sockaddr *fcgi_addr)
+	// respawn::options::output, open for as long as the spawning takes
+	struct OutputAnchor
 	{
+		int fd = -1;
+		OutputAnchor(const std::string& path)
+		{
+			if (path.empty())
+				return;
+
+			fd = os::open_output(path);
+			if (fd < 0)
+				ERR("cannot open the output file");
+		}
+		~OutputAnchor() { if (fd >= 0) ::close(fd); }
+	};
+
+	void check_if_used(sockaddr *fcgi_addr, std::chrono::milliseconds timeout, trace* tracer)
+	{
+		trace::span span{ tracer, "check_if_used" };
 		SocketAnchor fd{ socket(fcgi_addr->sa_family, SOCK_STREAM, 0) };
 
 		if (!fd)
 			ERR("socket");
 
-		if (0 == connect(fd.fd, fcgi_addr, sizeof(sockaddr_in)))
+		// a probe which did not finish in time is not conclusive,
+		// bind() will have the final word
+		if (os::connect_probe(fd.fd, fcgi_addr, sizeof(sockaddr_in), timeout))
 			ERR("socket is already used, can't spawn");
 	}
 
@@ -86,15 +105,24 @@ namespace remote
 		return (sockaddr *)&fcgi_addr_in;
 	}
 
-	SOCKET open(const char* addr, unsigned short port)
+	SOCKET open(const char* addr, unsigned short port, const respawn::options& opts)
 	{
+		auto tracer = opts.trace.get();
 		sockaddr_in fcgi_addr_in;
 
 		sockaddr *fcgi_addr = set(fcgi_addr_in, addr, port);
 
-		check_if_used(fcgi_addr);
+		if (opts.address_probe == respawn::probe::connect)
+			check_if_used(fcgi_addr, opts.probe_timeout, tracer);
 
+		// close-on-exec: a supervisor holds the listeners of all its pools, each
+		// worker gets only its own, as stdin (dup2 clears the flag there)
+		trace::span socket_span{ tracer, "socket" };
+#ifdef SOCK_CLOEXEC
+		SocketAnchor fd{ socket(fcgi_addr_in.sin_family, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+#else
 		SocketAnchor fd{ socket(fcgi_addr_in.sin_family, SOCK_STREAM, 0) };
+#endif
 
 		/* reopen socket */
 		if (!fd)
@@ -104,16 +132,60 @@ namespace remote
 		if (setsockopt(fd.fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&val, sizeof(val)) < 0)
 			ERR("setsockopt");
 
+		if (opts.address_probe == respawn::probe::reuseport)
+		{
+#ifdef SO_REUSEPORT
+			if (setsockopt(fd.fd, SOL_SOCKET, SO_REUSEPORT, (const char*)&val, sizeof(val)) < 0)
+				ERR("setsockopt(SO_REUSEPORT)");
+#else
+			ERR("SO_REUSEPORT is not supported");
+#endif
+		}
+		socket_span.close();
+
 		/* create socket */
+		trace::span bind_span{ tracer, "bind" };
 		if (-1 == bind(fd.fd, fcgi_addr, sizeof(fcgi_addr_in)))
 			ERR("bind failed");
 
+		// with SO_REUSEPORT the bind succeeds next to any listener of the
+		// same user; only the ones of this process may share the port
+		if (opts.address_probe == respawn::probe::reuseport && os::foreign_listener(fd.fd))
+			ERR("socket is already used, can't spawn");
+		bind_span.close();
+
+		trace::span listen_span{ tracer, "listen" };
 		if (-1 == listen(fd.fd, 1024))
 			ERR("listen");
+		listen_span.close();
 
 		return fd.release();
 	}
 
+	spawn_template make_template(const std::vector<std::string>& args, const respawn::options& opts)
+	{
+		spawn_template tmpl;
+		tmpl.args = args;
+		tmpl.identity = opts.identity;
+
+		if (opts.accept && *opts.accept)
+		{
+			std::ostringstream o;
+			o << accept_mutex::env_name << '=' << opts.accept->fd();
+			tmpl.env.push_back(o.str());
+			tmpl.inherit.push_back(opts.accept->fd());
+		}
+
+		if (opts.control && *opts.control)
+		{
+			tmpl.env.push_back(opts.control->env());
+			for (auto fd : opts.control->fds())
+				tmpl.inherit.push_back(fd);
+		}
+
+		return tmpl;
+	}
+
 	std::pair<std::string, unsigned short> break_addr(const std::string& address)
 	{
 		std::pair<std::string, unsigned short> out;
@@ -132,18 +204,106 @@ namespace remote
 		return out;
 	}
 
-	int respawn::fcgi(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args)
+	int respawn::listen(const std::string& address, const options& opts)
 	{
 		std::string addr;
 		unsigned short port;
 		std::tie(addr, port) = break_addr(address);
 
+		return open(addr.c_str(), port, opts);
+	}
+
+	int respawn::fcgi(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args)
+	{
+		return fcgi(log, address, args, options{});
+	}
+
+	int respawn::fcgi(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args, const options& opts)
+	{
+		auto tracer = opts.trace.get();
+		if (tracer)
+			tracer->lane_name(0, "spawner");
+
+		trace::span total{ tracer, "respawn::fcgi" };
+
+		std::string addr;
+		unsigned short port;
+		{
+			trace::span span{ tracer, "break_addr" };
+			std::tie(addr, port) = break_addr(address);
+		}
+
+		try
+		{
+			os::socklib lib;
+			SocketAnchor fd{ open(addr.c_str(), port, opts) };
+
+			OutputAnchor output{ opts.output };
+			auto tmpl = make_template(args, opts);
+			tmpl.output = output.fd;
+
+			errno = 0;
+			int ret = os::fcgi(fd.fd, tmpl, tracer, 1);
+			if (!ret)
+				LOG(log) << "Process spawned successfully";
+			else if (errno)
+				LOG(log) << "Could not execute " << (args.empty() ? "" : args[0]) << ": " << strerror(errno);
+
+			return ret;
+		}
+		catch (spawn_error& err)
+		{
+			LOG(log) << err.what();
+
+			return err.returnValue();
+		}
+		return 1;
+	}
+
+	int respawn::fcgi_pool(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args, size_t workers, const spawn_pacing& pacing, spawn_report& report)
+	{
+		return fcgi_pool(log, address, args, workers, pacing, report, options{});
+	}
+
+	int respawn::fcgi_pool(const logger_ptr& log, const std::string& address, const std::vector<std::string>& args, size_t workers, const spawn_pacing& pacing, spawn_report& report, const options& opts)
+	{
+		auto tracer = opts.trace.get();
+		if (tracer)
+			tracer->lane_name(0, "spawner");
+
+		trace::span total{ tracer, "respawn::fcgi_pool" };
+
+		std::string addr;
+		unsigned short port;
+		{
+			trace::span span{ tracer, "break_addr" };
+			std::tie(addr, port) = break_addr(address);
+		}
+
 		try
 		{
 			os::socklib lib;
-			SocketAnchor fd{ open(addr.c_str(), port) };
+			SocketAnchor fd{ open(addr.c_str(), port, opts) };
+
+			// one channel has a single receiver on each side, it cannot serve the whole pool
+			auto pool_opts = opts;
+			pool_opts.control.reset();
+
+			OutputAnchor output{ opts.output };
+			auto tmpl = make_template(args, pool_opts);
+			tmpl.output = output.fd;
+
+			int ret = os::fcgi_batch(fd.fd, tmpl, workers, pacing, report, tracer);
+
+			size_t id = 0;
+			for (auto&& batch : report.batches)
+			{
+				LOG(log) << "Batch #" << ++id << ": " << batch.ready << '/' << batch.started << " ready, "
+					<< batch.failed << " failed in "
+					<< std::chrono::duration_cast<std::chrono::milliseconds>(batch.elapsed).count() << "ms";
+			}
 
-			return os::fcgi(fd.fd, args);
+			return ret;
 		}
 		catch (spawn_error& err)
 		{
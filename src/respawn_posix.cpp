@@ -24,7 +24,14 @@
 
 #include "pch.h"
 #include <remote/respawn.hpp>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <grp.h>
+#include <dirent.h>
+#include <netinet/in.h>
 
 namespace remote
 {
@@ -40,21 +47,177 @@ namespace remote
 			::close(socket);
 		}
 
-		void exec(int stdIn, const std::vector<std::string>& args)
+		bool connect_probe(int socket, const void* addr, int addrlen, std::chrono::milliseconds timeout)
 		{
-			size_t size = sizeof(char*) * (args.size() + 1);
-			for (auto&& a : args)
+			int flags = fcntl(socket, F_GETFL, 0);
+			if (flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1)
+				return false;
+
+			if (!connect(socket, (const sockaddr*)addr, addrlen))
+				return true;
+
+			if (errno != EINPROGRESS)
+				return false;
+
+			// a signal does not restart the wait, the deadline stays where it was
+			auto deadline = std::chrono::steady_clock::now() + timeout;
+			pollfd pfd{ socket, POLLOUT, 0 };
+			int ret;
+			do
+			{
+				auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+				ret = poll(&pfd, 1, left > 0 ? (int)left : 0);
+			} while (ret < 0 && errno == EINTR);
+
+			if (ret <= 0)
+				return false;
+
+			int err = 0;
+			socklen_t len = sizeof(err);
+			if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &err, &len))
+				return false;
+
+			return !err;
+		}
+
+		namespace
+		{
+			// the inodes of the sockets this process has open
+			std::vector<unsigned long> own_sockets()
+			{
+				std::vector<unsigned long> out;
+				auto dir = opendir("/proc/self/fd");
+				if (!dir)
+					return out;
+
+				char link[64];
+				while (auto entry = readdir(dir))
+				{
+					auto len = readlinkat(dirfd(dir), entry->d_name, link, sizeof(link) - 1);
+					if (len <= 0)
+						continue;
+					link[len] = 0;
+
+					unsigned long inode;
+					if (sscanf(link, "socket:[%lu]", &inode) == 1)
+						out.push_back(inode);
+				}
+				closedir(dir);
+				return out;
+			}
+		}
+
+		bool foreign_listener(int socket)
+		{
+			sockaddr_in local{};
+			socklen_t len = sizeof(local);
+			if (getsockname(socket, (sockaddr*)&local, &len) || local.sin_family != AF_INET)
+				return false;
+
+			auto file = fopen("/proc/net/tcp", "re");
+			if (!file)
+				return false;
+
+			// "sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode"
+			std::vector<unsigned long> listeners;
+			char line[512];
+			while (fgets(line, sizeof(line), file))
+			{
+				unsigned addr, port, state;
+				unsigned long inode;
+				if (sscanf(line, " %*d: %x:%x %*x:%*x %x %*x:%*x %*x:%*x %*x %*u %*u %lu", &addr, &port, &state, &inode) != 4)
+					continue;
+
+				// 0A is TCP_LISTEN; the address is printed as the int it is in memory
+				if (state != 0x0A || port != ntohs(local.sin_port))
+					continue;
+				if (addr != local.sin_addr.s_addr && addr != INADDR_ANY && local.sin_addr.s_addr != INADDR_ANY)
+					continue;
+				listeners.push_back(inode);
+			}
+			fclose(file);
+
+			if (listeners.empty())
+				return false;
+
+			auto own = own_sockets();
+			for (auto inode : listeners)
+			{
+				if (std::find(own.begin(), own.end(), inode) == own.end())
+					return true;
+			}
+			return false;
+		}
+
+		namespace
+		{
+			struct limit_name
+			{
+				const char* name;
+				int resource;
+			} limit_names[] = {
+				{ "as", RLIMIT_AS },
+				{ "core", RLIMIT_CORE },
+				{ "cpu", RLIMIT_CPU },
+				{ "data", RLIMIT_DATA },
+				{ "fsize", RLIMIT_FSIZE },
+				{ "memlock", RLIMIT_MEMLOCK },
+				{ "nofile", RLIMIT_NOFILE },
+				{ "nproc", RLIMIT_NPROC },
+				{ "stack", RLIMIT_STACK },
+			};
+
+			const limit_name* find_limit(const std::string& name)
+			{
+				for (auto& limit : limit_names)
+				{
+					if (name == limit.name)
+						return &limit;
+				}
+				return nullptr;
+			}
+
+			void report(int status, int err)
+			{
+				if (status >= 0)
+					(void)!::write(status, &err, sizeof(err));
+			}
+		}
+
+		bool limit_known(const std::string& name)
+		{
+			return !!find_limit(name);
+		}
+
+		int open_output(const std::string& path)
+		{
+			return ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+		}
+
+		// packs the strings into a single allocation usable as argv/envp;
+		// the pointers from inherited (if any) are appended as-is
+		char** pack(const std::vector<std::string>& items, char** inherited = nullptr)
+		{
+			size_t count = items.size();
+			if (inherited)
+			{
+				for (auto it = inherited; *it; ++it)
+					++count;
+			}
+
+			size_t size = sizeof(char*) * (count + 1);
+			for (auto&& a : items)
 				size += a.length() + 1;
 
 			char* strings = new (std::nothrow) char[size];
 			if (!strings)
-				return;
+				return nullptr;
 
 			char** argv = (char**)strings;
-			strings += sizeof(char*) * (args.size() + 1);
+			strings += sizeof(char*) * (count + 1);
 
 			char** curr = argv;
-			for (auto&& a : args)
+			for (auto&& a : items)
 			{
 				auto len = a.length();
 				*curr++ = strings;
@@ -62,8 +225,52 @@ namespace remote
 				strings[len] = 0;
 				strings += len + 1;
 			}
+
+			if (inherited)
+			{
+				for (auto it = inherited; *it; ++it)
+					*curr++ = *it;
+			}
 			*curr = nullptr;
 
+			return argv;
+		}
+
+		// the identity switch uses the raw syscalls: after fork, the child is
+		// single-threaded, so there is no need for glibc's all-threads setxid
+		// machinery, which is not async-signal-safe
+		int switch_identity(const credentials& creds)
+		{
+#if defined(SYS_setgroups32)
+			// 32-bit x86 and friends, where the plain calls take 16-bit ids
+			if (!geteuid() && syscall(SYS_setgroups32, creds.groups.size(), creds.groups.data()))
+				return errno;
+			if (syscall(SYS_setresgid32, creds.gid, creds.gid, creds.gid))
+				return errno;
+			if (syscall(SYS_setresuid32, creds.uid, creds.uid, creds.uid))
+				return errno;
+#elif defined(__linux__)
+			if (!geteuid() && syscall(SYS_setgroups, creds.groups.size(), creds.groups.data()))
+				return errno;
+			if (syscall(SYS_setresgid, creds.gid, creds.gid, creds.gid))
+				return errno;
+			if (syscall(SYS_setresuid, creds.uid, creds.uid, creds.uid))
+				return errno;
+#else
+			if (!geteuid() && setgroups(creds.groups.size(), (const gid_t*)creds.groups.data()))
+				return errno;
+			if (setgid(creds.gid))
+				return errno;
+			if (setuid(creds.uid))
+				return errno;
+#endif
+			return 0;
+		}
+
+		// runs in the child, between fork and exec; everything here
+		// is prepared up front by the parent, so nothing allocates
+		void exec(int stdIn, const spawn_template& tmpl, char** argv, char** envp, int status)
+		{
 			if (stdIn != STDIN_FILENO)
 			{
 				close(STDIN_FILENO);
@@ -72,41 +279,322 @@ namespace remote
 			}
 
 			auto fd = open("/dev/null", O_RDWR);
-			if (fd >= 0)
+			auto out = tmpl.output >= 0 ? tmpl.output : fd;
+			if (out >= 0)
 			{
-				if (fd != STDERR_FILENO)
-					dup2(fd, STDERR_FILENO);
+				if (out != STDERR_FILENO)
+					dup2(out, STDERR_FILENO);
 
-				if (fd != STDOUT_FILENO)
-					dup2(fd, STDOUT_FILENO);
+				if (out != STDOUT_FILENO)
+					dup2(out, STDOUT_FILENO);
+			}
+			if (fd >= 0 && fd != STDOUT_FILENO && fd != STDERR_FILENO)
+				close(fd);
 
-				if (fd != STDOUT_FILENO && fd != STDERR_FILENO)
-					close(fd);
+			for (auto&& inherited : tmpl.inherit)
+			{
+				int flags = fcntl(inherited, F_GETFD);
+				if (flags != -1)
+					fcntl(inherited, F_SETFD, flags & ~FD_CLOEXEC);
 			}
 
 			//spawn-fcgi closes all sockets between STDERR and fd
 			for (int i = 3; i < fd; i++)
 			{
-				if (i != STDIN_FILENO)
-					close(i);
+				if (i == STDIN_FILENO || i == status)
+					continue;
+				if (std::find(tmpl.inherit.begin(), tmpl.inherit.end(), i) != tmpl.inherit.end())
+					continue;
+				close(i);
 			}
 
-			execv(argv[0], argv);
+			// the group may be gone with its last member; then this
+			// worker starts a new one, see process_group()
+			if (tmpl.process_group >= 0 && setpgid(0, tmpl.process_group))
+				setpgid(0, 0);
+
+			for (auto&& limit : tmpl.limits)
+			{
+				auto res = find_limit(limit.first);
+				if (!res)
+					continue;
+
+				rlimit value;
+				value.rlim_cur = value.rlim_max = (rlim_t)limit.second;
+				if (setrlimit(res->resource, &value))
+				{
+					report(status, errno);
+					return;
+				}
+			}
+
+			if (tmpl.identity)
+			{
+				int err = switch_identity(*tmpl.identity);
+				if (err)
+				{
+					report(status, err);
+					return;
+				}
+			}
+
+			execve(argv[0], argv, envp);
+
+			// the status pipe is close-on-exec, so the parent only gets
+			// the errno if the execve above did not replace this image
+			report(status, errno);
 		}
 
-		int fcgi(int stdIn, const std::vector<std::string>& args)
+		struct launched
+		{
+			pid_t pid = -1;
+			int status = -1; // read end of the close-on-exec status pipe
+			trace::clock::time_point forked;
+			int lane = 0;
+		};
+
+		launched launch(int stdIn, const spawn_template& tmpl, trace* tracer, int lane)
 		{
+			launched out;
+			out.lane = lane;
+
+			std::unique_ptr<char[]> argv{ (char*)pack(tmpl.args) };
+			if (!argv)
+				return out;
+
+			// entries from the template come first, so they win over the inherited ones
+			std::unique_ptr<char[]> env;
+			if (!tmpl.env.empty())
+			{
+				env.reset((char*)pack(tmpl.env, environ));
+				if (!env)
+					return out;
+			}
+			char** envp = env ? (char**)env.get() : environ;
+
+			int status_pipe[2] = { -1, -1 };
+			if (pipe2(status_pipe, O_CLOEXEC))
+				status_pipe[0] = status_pipe[1] = -1;
+
+			trace::span fork_span{ tracer, "fork", "respawn", lane };
 			pid_t child = fork();
 			if (child == 0)
-				exec(stdIn, args);
+			{
+				if (status_pipe[0] >= 0)
+					::close(status_pipe[0]);
+				exec(stdIn, tmpl, (char**)argv.get(), envp, status_pipe[1]);
+				_exit(127);
+			}
+			fork_span.close();
+			out.forked = trace::clock::now();
+
+			if (status_pipe[1] >= 0)
+				::close(status_pipe[1]);
+
+			if (child < 0)
+			{
+				if (status_pipe[0] >= 0)
+					::close(status_pipe[0]);
+				return out;
+			}
+
+			if (tracer)
+			{
+				std::ostringstream name;
+				name << "worker " << child;
+				tracer->lane_name(lane, name.str());
+			}
+
+			out.pid = child;
+			out.status = status_pipe[0];
+			return out;
+		}
 
+		// EOF on the status pipe means the child got through execv
+		int exec_result(launched& worker, trace* tracer)
+		{
+			int err = 0;
+			ssize_t got;
+			do
+			{
+				got = ::read(worker.status, &err, sizeof(err));
+			} while (got < 0 && errno == EINTR);
+			if (got != sizeof(err))
+				err = 0;
+
+			::close(worker.status);
+			worker.status = -1;
+
+			if (tracer)
+				tracer->record("exec", "respawn", worker.lane, worker.forked, trace::clock::now());
+
+			return err;
+		}
+
+		// a worker which failed to exec is reaped here, and errno is left
+		// at the reason it failed, for the caller to report
+		int finish(launched& worker, int err)
+		{
 			int status = -1;
-			int ret = waitpid(child, &status, WNOHANG);
-			if (!ret)
-				printf("Process %d spawned successfully\n", child);
+			int ret = err ? waitpid(worker.pid, &status, 0) : waitpid(worker.pid, &status, WNOHANG);
+			if (err)
+				errno = err;
 
 			return ret;
 		}
 
+		int fcgi(int stdIn, const spawn_template& tmpl, trace* tracer, int lane)
+		{
+			auto worker = launch(stdIn, tmpl, tracer, lane);
+			if (worker.pid < 0)
+				return -1;
+
+			int err = worker.status >= 0 ? exec_result(worker, tracer) : 0;
+			return finish(worker, err);
+		}
+
+		int fcgi_batch(int stdIn, const spawn_template& tmpl, size_t count, const spawn_pacing& pacing, spawn_report& report, trace* tracer)
+		{
+			using clock = std::chrono::steady_clock;
+
+			report = spawn_report{};
+			size_t concurrency = pacing.concurrency ? pacing.concurrency : 1;
+			size_t spawned = 0;
+			bool all_ready = true;
+
+			while (spawned < count)
+			{
+				auto start = clock::now();
+				spawn_batch batch;
+
+				std::vector<launched> pending;
+				while (spawned < count && pending.size() < concurrency)
+				{
+					auto worker = launch(stdIn, tmpl, tracer, (int)++spawned);
+					++batch.started;
+					if (worker.pid < 0)
+					{
+						++batch.failed;
+						continue;
+					}
+
+					report.pids.push_back(worker.pid);
+					if (worker.status < 0)
+					{
+						// no status pipe, nothing to wait for
+						++batch.ready;
+						continue;
+					}
+					pending.push_back(worker);
+				}
+
+				auto deadline = clock::now() + pacing.ready_timeout;
+				std::vector<pollfd> fds;
+				while (!pending.empty())
+				{
+					auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+					if (left < 0)
+						left = 0;
+
+					fds.clear();
+					for (auto&& worker : pending)
+						fds.push_back({ worker.status, POLLIN, 0 });
+
+					int ret = poll(fds.data(), fds.size(), (int)left);
+					if (ret < 0 && errno == EINTR)
+						continue;
+					if (ret <= 0)
+						break;
+
+					for (size_t i = fds.size(); i > 0; --i)
+					{
+						if (!fds[i - 1].revents)
+							continue;
+
+						auto& worker = pending[i - 1];
+						int err = exec_result(worker, tracer);
+						if (finish(worker, err))
+						{
+							++batch.failed;
+							report.pids.erase(std::find(report.pids.begin(), report.pids.end(), worker.pid));
+						}
+						else
+							++batch.ready;
+						pending.erase(pending.begin() + (i - 1));
+					}
+				}
+
+				// whatever did not get through exec in time is stopped, so it
+				// neither serves half-started nor stays behind as a zombie
+				for (auto&& worker : pending)
+				{
+					++batch.failed;
+					::close(worker.status);
+					::kill(worker.pid, SIGKILL);
+					while (waitpid(worker.pid, nullptr, 0) < 0 && errno == EINTR)
+						;
+					report.pids.erase(std::find(report.pids.begin(), report.pids.end(), worker.pid));
+					report.timed_out.push_back(worker.pid);
+				}
+
+				batch.elapsed = clock::now() - start;
+				if (batch.failed)
+					all_ready = false;
+				report.batches.push_back(batch);
+
+				if (spawned < count && pacing.ramp.count() > 0)
+					std::this_thread::sleep_for(pacing.ramp);
+			}
+
+			return all_ready ? 0 : 1;
+		}
+
+		int spawn(int stdIn, const spawn_template& tmpl, trace* tracer, int lane)
+		{
+			auto worker = launch(stdIn, tmpl, tracer, lane);
+			if (worker.pid < 0)
+				return -1;
+
+			int err = worker.status >= 0 ? exec_result(worker, tracer) : 0;
+			if (finish(worker, err))
+				return -1;
+
+			return worker.pid;
+		}
+
+		int reap(int& status)
+		{
+			return reap(-1, status);
+		}
+
+		int reap(int pid, int& status)
+		{
+			int ret;
+			do
+			{
+				ret = waitpid(pid, &status, WNOHANG);
+			} while (ret < 0 && errno == EINTR);
+
+			if (ret <= 0)
+				return 0;
+
+			if (WIFEXITED(status))
+				status = WEXITSTATUS(status);
+			else if (WIFSIGNALED(status))
+				status = 128 + WTERMSIG(status);
+
+			return ret;
+		}
+
+		bool terminate(int pid, bool force)
+		{
+			return !::kill(pid, force ? SIGKILL : SIGTERM);
+		}
+
+		int process_group(int pid)
+		{
+			int pgid = getpgid(pid);
+			return pgid < 0 ? 0 : pgid;
+		}
 	}
 }
@@ -73,6 +73,35 @@ namespace remote
 			closesocket(socket);
 		}
 
+		bool connect_probe(int socket, const void* addr, int addrlen, std::chrono::milliseconds timeout)
+		{
+			u_long nonblocking = 1;
+			if (ioctlsocket(socket, FIONBIO, &nonblocking))
+				return false;
+
+			if (!connect(socket, (const sockaddr*)addr, addrlen))
+				return true;
+
+			if (WSAGetLastError() != WSAEWOULDBLOCK)
+				return false;
+
+			WSAPOLLFD pfd{ (SOCKET)socket, POLLOUT, 0 };
+			if (WSAPoll(&pfd, 1, (INT)timeout.count()) <= 0)
+				return false;
+
+			int err = 0;
+			int len = sizeof(err);
+			if (getsockopt(socket, SOL_SOCKET, SO_ERROR, (char*)&err, &len))
+				return false;
+
+			return !err;
+		}
+
+		bool foreign_listener(int)
+		{
+			return false;
+		}
+
 		std::string shellescape(const std::string& arg)
 		{
 			std::string out;
@@ -89,7 +118,7 @@ namespace remote
 			return out;
 		}
 
-		int fcgi(int stdIn, const std::vector<std::string>& args)
+		DWORD create_process(int stdIn, const spawn_template& tmpl, trace* tracer, int lane, HANDLE* process = nullptr)
 		{
 			PROCESS_INFORMATION pi;
 			STARTUPINFOA si;
@@ -105,7 +134,7 @@ namespace remote
 
 			std::ostringstream o;
 			bool first = true;
-			for (auto&& arg : args)
+			for (auto&& arg : tmpl.args)
 			{
 				if (first) first = false;
 				else o << ' ';
@@ -132,19 +161,177 @@ namespace remote
 			GetModuleFileNameA(nullptr, appname, sizeof(appname));
 			appname[sizeof(appname)-1] = 0;
 
-			if (!CreateProcessA(appname, &cmdLine[0], nullptr, nullptr, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED, nullptr, nullptr, &si, &pi))
+			std::string environment;
+			if (!tmpl.env.empty())
+			{
+				for (auto&& var : tmpl.env)
+				{
+					environment.append(var);
+					environment.push_back(0);
+				}
+
+				auto inherited = GetEnvironmentStringsA();
+				if (inherited)
+				{
+					auto ptr = inherited;
+					while (*ptr)
+					{
+						auto len = strlen(ptr) + 1;
+						environment.append(ptr, len);
+						ptr += len;
+					}
+					FreeEnvironmentStringsA(inherited);
+				}
+				environment.push_back(0);
+			}
+
+			trace::span spawn_span{ tracer, "CreateProcess", "respawn", lane };
+			if (!CreateProcessA(appname, &cmdLine[0], nullptr, nullptr, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED, environment.empty() ? nullptr : &environment[0], nullptr, &si, &pi))
 			{
 				ERR("CreateProcess failed");
 			}
+			spawn_span.close();
+
+			if (tracer)
+			{
+				std::ostringstream name;
+				name << "worker " << pi.dwProcessId;
+				tracer->lane_name(lane, name.str());
+			}
 
 			// You can break here to attach to the spawned process
 			ResumeThread(pi.hThread);
 
-			printf("Process %d spawned successfully\n", pi.dwProcessId);
+			if (process)
+				*process = pi.hProcess;
+			else
+				CloseHandle(pi.hProcess);
+			CloseHandle(pi.hThread);
+
+			return pi.dwProcessId;
+		}
+
+		int fcgi(int stdIn, const spawn_template& tmpl, trace* tracer, int lane)
+		{
+			create_process(stdIn, tmpl, tracer, lane);
+			return 0;
+		}
+
+		int fcgi_batch(int stdIn, const spawn_template& tmpl, size_t count, const spawn_pacing& pacing, spawn_report& report, trace* tracer)
+		{
+			using clock = std::chrono::steady_clock;
+
+			report = spawn_report{};
+			size_t concurrency = pacing.concurrency ? pacing.concurrency : 1;
+			size_t spawned = 0;
+			bool all_ready = true;
+
+			// CreateProcess does not wait for the child, so a batch is ready
+			// as soon as all of its processes are created
+			while (spawned < count)
+			{
+				auto start = clock::now();
+				spawn_batch batch;
+
+				for (size_t i = 0; spawned < count && i < concurrency; ++i)
+				{
+					++batch.started;
+					try
+					{
+						report.pids.push_back(create_process(stdIn, tmpl, tracer, (int)++spawned));
+						++batch.ready;
+					}
+					catch (spawn_error&)
+					{
+						++batch.failed;
+					}
+				}
+
+				batch.elapsed = clock::now() - start;
+				if (batch.failed)
+					all_ready = false;
+				report.batches.push_back(batch);
+
+				if (spawned < count && pacing.ramp.count() > 0)
+					std::this_thread::sleep_for(pacing.ramp);
+			}
+
+			return all_ready ? 0 : 1;
+		}
+
+		namespace
+		{
+			std::mutex s_children_mutex;
+			std::map<int, HANDLE> s_children;
+		}
+
+		int spawn(int stdIn, const spawn_template& tmpl, trace* tracer, int lane)
+		{
+			HANDLE process = nullptr;
+			try
+			{
+				int pid = (int)create_process(stdIn, tmpl, tracer, lane, &process);
 
-			CloseHandle(pi.hProcess);
+				std::lock_guard<std::mutex> guard(s_children_mutex);
+				s_children[pid] = process;
+				return pid;
+			}
+			catch (spawn_error&)
+			{
+				return -1;
+			}
+		}
 
+		int reap(int& status)
+		{
+			return reap(-1, status);
+		}
+
+		int reap(int pid, int& status)
+		{
+			std::lock_guard<std::mutex> guard(s_children_mutex);
+			for (auto it = s_children.begin(); it != s_children.end(); ++it)
+			{
+				if (pid > 0 && it->first != pid)
+					continue;
+				if (WaitForSingleObject(it->second, 0) != WAIT_OBJECT_0)
+					continue;
+
+				DWORD code = 0;
+				GetExitCodeProcess(it->second, &code);
+				CloseHandle(it->second);
+
+				status = (int)code;
+				int reaped = it->first;
+				s_children.erase(it);
+				return reaped;
+			}
 			return 0;
 		}
+
+		bool terminate(int pid, bool)
+		{
+			// there is no polite request to quit a console-less process, forced or not
+			std::lock_guard<std::mutex> guard(s_children_mutex);
+			auto it = s_children.find(pid);
+			if (it == s_children.end())
+				return false;
+			return TerminateProcess(it->second, 1) != FALSE;
+		}
+
+		int process_group(int)
+		{
+			return 0;
+		}
+
+		bool limit_known(const std::string&)
+		{
+			return false;
+		}
+
+		int open_output(const std::string&)
+		{
+			return -1;
+		}
 	}
-}
+}
\ No newline at end of file
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/ring_log.hpp>
+#include <chrono>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace remote
+{
+	namespace
+	{
+		constexpr size_t header_size = 4096;
+		constexpr uint64_t min_capacity = 64 * 1024;
+		constexpr uint32_t max_file = 1024;
+
+		enum : uint32_t
+		{
+			writing = 0,
+			written = 0x4c494e45, // "ENIL"
+			padding = 0x44444150  // "PADD"
+		};
+
+		struct ring_header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t capacity;
+			std::atomic<uint64_t> head;
+			int32_t pid;
+		};
+
+		struct record
+		{
+			uint64_t position;
+			uint32_t size;
+			std::atomic<uint32_t> state;
+			int64_t time;
+			uint32_t line;
+			uint16_t file_length;
+			uint16_t unused;
+			uint32_t text_length;
+		};
+
+		constexpr size_t padding_size = 16; // up to and including the state
+		static_assert(sizeof(record) == 40, "the record layout is part of the file format");
+		static_assert(alignof(record) <= 16, "records are aligned to 16 bytes");
+
+		uint64_t align(uint64_t size) { return (size + 15) & ~uint64_t(15); }
+
+		int64_t now()
+		{
+			using namespace std::chrono;
+			return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	namespace ring_log
+	{
+		reader::reader(const std::string& path)
+		{
+			FILE* file = fopen(path.c_str(), "rb");
+			if (!file)
+				return;
+
+			ring_header header;
+			memset((void*)&header, 0, sizeof(header));
+			bool valid = fread((void*)&header, sizeof(header), 1, file) == 1
+				&& header.magic == magic && header.version == version
+				&& header.capacity >= min_capacity && !(header.capacity & (header.capacity - 1))
+				&& !fseek(file, header_size, SEEK_SET);
+
+			if (valid)
+			{
+				m_ring.resize((size_t)header.capacity);
+				valid = fread(&m_ring[0], m_ring.size(), 1, file) == 1;
+			}
+			fclose(file);
+
+			if (!valid)
+				return;
+
+			m_head = header.head.load();
+			m_pid = header.pid;
+			m_next = m_head > header.capacity ? m_head - header.capacity : 0;
+			m_next = align(m_next);
+			m_valid = true;
+		}
+
+		bool reader::next(entry& out)
+		{
+			uint64_t capacity = m_ring.size();
+			bool resync = false;
+			while (m_valid && m_next + padding_size <= m_head)
+			{
+				auto offset = m_next & (capacity - 1);
+				auto rec = (const record*)(m_ring.data() + offset);
+
+				// the oldest record in the ring was cut by the newest one (which
+				// is not a loss), or a writer died between reserving its record
+				// and filling it in
+				if (rec->position != m_next || rec->size < padding_size || rec->size % 16 || offset + rec->size > capacity)
+				{
+					if (!resync && m_synced)
+						++m_lost;
+					resync = true;
+					m_next += 16;
+					continue;
+				}
+				resync = false;
+				m_synced = true;
+				m_next += rec->size;
+
+				auto state = rec->state.load(std::memory_order_relaxed);
+				if (state == padding)
+					continue;
+
+				if (state != written || rec->size < sizeof(record) + (uint64_t)rec->file_length + rec->text_length)
+				{
+					++m_lost;
+					continue;
+				}
+
+				auto data = (const char*)(rec + 1);
+				out.time = rec->time;
+				out.line = (int)rec->line;
+				out.file.assign(data, rec->file_length);
+				out.text.assign(data + rec->file_length, rec->text_length);
+				return true;
+			}
+
+			return false;
+		}
+	}
+
+	ring_logger::ring_logger(const std::string& path, size_t capacity)
+	{
+		uint64_t size = min_capacity;
+		while (size < capacity)
+			size <<= 1;
+
+		if (!map(path, size))
+			release();
+	}
+
+	ring_logger::~ring_logger()
+	{
+		release();
+	}
+
+	void ring_logger::write(const char* path, int line, std::string_view text)
+	{
+		if (!m_memory)
+			return;
+
+		size_t file_length = path ? std::min(strlen(path), (size_t)max_file) : 0;
+
+		// a quarter of the ring at most, so a line never pushes out everything else
+		auto max_text = m_capacity / 4 - sizeof(record) - file_length;
+		if (text.size() > max_text)
+			text = text.substr(0, (size_t)max_text);
+
+		auto size = align(sizeof(record) + file_length + text.size());
+
+		// reserve; a record which would not fit before the end of the ring
+		// starts over at its beginning, behind a padding record
+		auto header = (ring_header*)m_memory;
+		uint64_t position = header->head.load(std::memory_order_relaxed);
+		uint64_t skip = 0;
+		do
+		{
+			auto offset = position & (m_capacity - 1);
+			skip = offset + size > m_capacity ? m_capacity - offset : 0;
+		} while (!header->head.compare_exchange_weak(position, position + skip + size, std::memory_order_relaxed));
+
+		if (skip)
+		{
+			auto pad = (record*)(ring() + (position & (m_capacity - 1)));
+			pad->state.store(writing, std::memory_order_relaxed);
+			pad->size = (uint32_t)skip;
+			pad->position = position;
+			pad->state.store(padding, std::memory_order_release);
+			position += skip;
+		}
+
+		// the state goes back to writing before the position says the record
+		// is a new one, so a reader never takes the old state for the new record
+		auto rec = (record*)(ring() + (position & (m_capacity - 1)));
+		rec->state.store(writing, std::memory_order_relaxed);
+		rec->size = (uint32_t)size;
+		std::atomic_thread_fence(std::memory_order_release);
+		rec->position = position;
+
+		rec->time = now();
+		rec->line = (uint32_t)line;
+		rec->file_length = (uint16_t)file_length;
+		rec->unused = 0;
+		rec->text_length = (uint32_t)text.size();
+		auto data = (char*)(rec + 1);
+		if (file_length)
+			memcpy(data, path, file_length);
+		if (!text.empty())
+			memcpy(data + file_length, text.data(), text.size());
+
+		rec->state.store(written, std::memory_order_release);
+	}
+
+#ifdef _WIN32
+	// no flight recorder there yet; the logger stays closed and drops everything
+	bool ring_logger::map(const std::string&, uint64_t) { return false; }
+	void ring_logger::release() {}
+#else
+	bool ring_logger::map(const std::string& path, uint64_t capacity)
+	{
+		m_size = header_size + (size_t)capacity;
+		m_capacity = capacity;
+
+		m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+		if (m_fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(m_fd, &st))
+			return false;
+
+		// a file just created only grows, nobody can have anything of it mapped
+		bool fresh = !st.st_size;
+		if (fresh && ftruncate(m_fd, (off_t)m_size))
+			return false;
+
+		if (fresh || (uint64_t)st.st_size == m_size)
+		{
+			void* ptr = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+			if (ptr == MAP_FAILED)
+				return false;
+			m_memory = (char*)ptr;
+		}
+
+		auto header = (ring_header*)m_memory;
+		if (!fresh && (!header || header->magic != ring_log::magic || header->version != ring_log::version || header->capacity != capacity))
+		{
+			// another ring, which a live process may still have mapped: truncating
+			// or clearing it would pull it from under that process (SIGBUS on the
+			// next write). A new file takes its name instead, the old one lives on
+			// for as long as it is mapped
+			release();
+
+			auto name = path + ".XXXXXX";
+			m_fd = mkostemp(&name[0], O_CLOEXEC);
+			if (m_fd < 0)
+				return false;
+			if (fchmod(m_fd, 0640) || ftruncate(m_fd, (off_t)m_size))
+			{
+				unlink(name.c_str());
+				return false;
+			}
+
+			void* ptr = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+			if (ptr == MAP_FAILED || rename(name.c_str(), path.c_str()))
+			{
+				if (ptr != MAP_FAILED)
+					munmap(ptr, m_size);
+				unlink(name.c_str());
+				return false;
+			}
+			m_memory = (char*)ptr;
+			header = (ring_header*)m_memory;
+			fresh = true;
+		}
+
+		if (fresh)
+		{
+			memset(m_memory, 0, header_size);
+			header->version = ring_log::version;
+			header->capacity = capacity;
+			header->head.store(0);
+			header->magic = ring_log::magic;
+		}
+
+		header->pid = (int32_t)getpid();
+		return true;
+	}
+
+	void ring_logger::release()
+	{
+		if (m_memory)
+			munmap(m_memory, m_size);
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_memory = nullptr;
+		m_fd = -1;
+	}
+#endif
+}
@@ -23,3 +23,40 @@
  */
 
 #include "pch.h"
+#include <remote/signals.hpp>
+
+namespace remote
+{
+	namespace
+	{
+		const char command_signal[] = "command";
+
+		int pack(command cmd, unsigned arg)
+		{
+			return (int)(((unsigned)cmd << 24) | (arg & 0xFFFFFF));
+		}
+	}
+
+	signal_token signals::on_command(const command_t& fn)
+	{
+		return os_sig->subscribe(command_signal, signal_info_t{ [fn](const signal_info& info)
+		{
+			// plain kill()s of the signal are not commands
+			if (!info.queued)
+				return;
+
+			auto value = (unsigned)info.value;
+			fn((remote::command)(value >> 24), value & 0xFFFFFF, info.sender);
+		} });
+	}
+
+	bool signals::command(int pid, remote::command cmd, unsigned arg)
+	{
+		return os_sig->queue(command_signal, pid, pack(cmd, arg));
+	}
+
+	std::vector<bool> signals::command(const std::vector<int>& pids, remote::command cmd, unsigned arg)
+	{
+		return os_sig->queue(command_signal, pids, pack(cmd, arg));
+	}
+}
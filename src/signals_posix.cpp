@@ -24,81 +24,531 @@
 
 #include "pch.h"
 #include <remote/signals.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <unordered_map>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 namespace remote
 {
 	namespace posix
 	{
-		static logger_ptr s_log;
-
-		struct mapping_t
+		/*
+		 * Process-wide table of the subscribers, indexed by the signal number.
+		 * The handler itself only writes the number (and the sender) into a
+		 * pipe; the subscribers are called on the registry's own thread, where
+		 * they are free to lock, allocate and log.
+		 */
+		class registry
 		{
-			const char* name;
-			int signal;
-			signal_t function;
-		} mapping[] = {
-			{ "stop", SIGTERM },
-			{ "reload", SIGHUP }
-		};
+			struct subscriber
+			{
+				signal_token token;
+				signal_info_t function;
+				logger_ptr log; // of the signals object which subscribed
+			};
 
-		class signals : public os::signals
-		{
-			static mapping_t* find(const char* sig)
+			struct slot
 			{
-				for (auto& m : mapping)
+				std::string name;
+				std::vector<subscriber> subscribers;
+				bool installed = false;
+				struct sigaction previous;
+			};
+
+			struct record
+			{
+				int signal;
+				int pid;
+				int value;
+				int queued;
+			};
+
+			std::mutex m_mutex;
+			std::condition_variable m_called; // a subscriber returned
+			signal_token m_running = 0;       // the subscriber being called
+			slot m_slots[NSIG];
+			std::unordered_map<std::string, int> m_names;
+			signal_token m_next_token = 0;
+			int m_pipe[2] = { -1, -1 };
+			std::thread m_thread;
+			std::thread::id m_dispatcher;
+			std::atomic<unsigned long> m_dropped{ 0 };
+
+			static registry* s_instance;
+
+			registry()
+			{
+				static const struct
+				{
+					const char* name;
+					int signal;
+				} known[] = {
+					{ "SIGHUP", SIGHUP }, { "SIGINT", SIGINT }, { "SIGQUIT", SIGQUIT },
+					{ "SIGILL", SIGILL }, { "SIGTRAP", SIGTRAP }, { "SIGABRT", SIGABRT },
+					{ "SIGBUS", SIGBUS }, { "SIGFPE", SIGFPE }, { "SIGKILL", SIGKILL },
+					{ "SIGUSR1", SIGUSR1 }, { "SIGSEGV", SIGSEGV }, { "SIGUSR2", SIGUSR2 },
+					{ "SIGPIPE", SIGPIPE }, { "SIGALRM", SIGALRM }, { "SIGTERM", SIGTERM },
+					{ "SIGCHLD", SIGCHLD }, { "SIGCONT", SIGCONT }, { "SIGSTOP", SIGSTOP },
+					{ "SIGTSTP", SIGTSTP }, { "SIGTTIN", SIGTTIN }, { "SIGTTOU", SIGTTOU },
+					{ "SIGURG", SIGURG }, { "SIGXCPU", SIGXCPU }, { "SIGXFSZ", SIGXFSZ },
+					{ "SIGVTALRM", SIGVTALRM }, { "SIGPROF", SIGPROF }, { "SIGWINCH", SIGWINCH },
+					{ "SIGSYS", SIGSYS },
+#ifdef SIGIO
+					{ "SIGIO", SIGIO },
+#endif
+#ifdef SIGPWR
+					{ "SIGPWR", SIGPWR },
+#endif
+				};
+
+				for (auto&& sig : known)
 				{
-					if (!strcmp(sig, m.name))
-						return &m;
+					m_names[sig.name] = sig.signal;
+					m_slots[sig.signal].name = sig.name;
+
+					// "SIGUSR1" -> "usr1"
+					std::string alias = sig.name + 3;
+					for (auto& c : alias)
+						c = (char)tolower((unsigned char)c);
+					m_names.emplace(alias, sig.signal);
 				}
-				return nullptr;
+
+				for (int sig = SIGRTMIN; sig <= SIGRTMAX; ++sig)
+				{
+					std::ostringstream canonical, alias;
+					canonical << "SIGRTMIN+" << (sig - SIGRTMIN);
+					alias << "rt" << (sig - SIGRTMIN);
+					m_slots[sig].name = canonical.str();
+					m_names[canonical.str()] = sig;
+					m_names[alias.str()] = sig;
+				}
+				m_names["SIGRTMIN"] = SIGRTMIN;
+				m_names["SIGRTMAX"] = SIGRTMAX;
+
+				// the names this library always used; "stop" is SIGTERM, not SIGSTOP
+				m_names["stop"] = SIGTERM;
+				m_names["reload"] = SIGHUP;
+				m_names["child"] = SIGCHLD;
+				m_names["command"] = SIGRTMIN;
+
+				if (pipe2(m_pipe, O_CLOEXEC))
+					throw std::runtime_error("Signals did not started");
+				fcntl(m_pipe[1], F_SETFL, fcntl(m_pipe[1], F_GETFL) | O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+				// room for a burst of queued commands; the default holds 4096 records
+				fcntl(m_pipe[1], F_SETPIPE_SZ, 256 * 1024);
+#endif
+
+				m_thread = std::thread([this] { run(); });
+				m_dispatcher = m_thread.get_id();
+				m_thread.detach();
 			}
 
-			static mapping_t* find(int sig)
+			static void handler(int sig, siginfo_t* info, void*)
 			{
-				for (auto& m : mapping)
+				int err = errno;
+				record rec{ sig, 0, 0, 0 };
+				if (info)
 				{
-					if (sig == m.signal)
-						return &m;
+					rec.pid = (int)info->si_pid;
+					if (info->si_code == SI_QUEUE)
+					{
+						rec.value = info->si_value.sival_int;
+						rec.queued = 1;
+					}
 				}
-				return nullptr;
+				if (::write(s_instance->m_pipe[1], &rec, sizeof(rec)) != sizeof(rec))
+					++s_instance->m_dropped;
+				errno = err;
 			}
 
-			static void function(int sig)
+			void run()
 			{
-				auto map = find(sig);
-				if (!map || !map->function)
-					return;
+				// the handler must run on some other thread: on this one, a storm
+				// keeps interrupting the only reader of the pipe it fills
+				sigset_t all;
+				sigfillset(&all);
+				pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+				record rec;
+				for (;;)
+				{
+					auto got = ::read(m_pipe[0], &rec, sizeof(rec));
+					if (got < 0 && errno == EINTR)
+						continue;
+					if (got != sizeof(rec))
+						return;
+
+					if (rec.signal <= 0 || rec.signal >= NSIG)
+						continue;
+
+					std::vector<std::pair<signal_token, signal_info_t>> functions;
+					std::vector<logger_ptr> logs;
+					std::string name;
+					{
+						std::lock_guard<std::mutex> guard(m_mutex);
+						auto& slot = m_slots[rec.signal];
+						functions.reserve(slot.subscribers.size());
+						for (auto&& sub : slot.subscribers)
+						{
+							functions.emplace_back(sub.token, sub.function);
+							if (sub.log && std::find(logs.begin(), logs.end(), sub.log) == logs.end())
+								logs.push_back(sub.log);
+						}
+						name = slot.name;
+					}
+
+					if (functions.empty())
+						continue;
+
+					for (auto&& log : logs)
+						LOG(log) << "Signalled " << rec.signal << "/" << name << "...";
+
+					signal_info info;
+					info.signal = rec.signal;
+					info.sender = rec.pid;
+					info.value = rec.value;
+					info.queued = rec.queued != 0;
+
+					for (auto&& fn : functions)
+					{
+						// the copy may be stale: a subscriber which is gone by now
+						// is not called, one which is being called is waited for
+						{
+							std::lock_guard<std::mutex> guard(m_mutex);
+							if (!subscribed(rec.signal, fn.first))
+								continue;
+							m_running = fn.first;
+						}
 
-				LOG(s_log) << "Signalled " << map->signal << "/" << map->name << "...";
-				map->function();
+						fn.second(info);
+
+						{
+							std::lock_guard<std::mutex> guard(m_mutex);
+							m_running = 0;
+						}
+						m_called.notify_all();
+					}
+				}
+			}
+
+			bool subscribed(int sig, signal_token token) const
+			{
+				auto& subs = m_slots[sig].subscribers;
+				return std::any_of(subs.begin(), subs.end(), [token](const subscriber& sub) { return sub.token == token; });
+			}
+
+			bool install(int sig, slot& slot)
+			{
+				struct sigaction action;
+				memset(&action, 0, sizeof(action));
+				action.sa_sigaction = handler;
+				action.sa_flags = SA_SIGINFO | SA_RESTART;
+				sigemptyset(&action.sa_mask);
+
+				if (sigaction(sig, &action, &slot.previous))
+					return false;
+
+				slot.installed = true;
+				return true;
 			}
 
 		public:
+			static registry& get()
+			{
+				// never destroyed, the dispatching thread may outlive main()
+				static registry* instance = s_instance = new registry;
+				return *instance;
+			}
+
+			int find(const char* name)
+			{
+				if (!name)
+					return 0;
+				auto it = m_names.find(name);
+				return it == m_names.end() ? 0 : it->second;
+			}
+
+			std::string name(int sig)
+			{
+				if (sig <= 0 || sig >= NSIG)
+					return std::string();
+				return m_slots[sig].name;
+			}
+
+			// the faults are raised by the faulting instruction itself: a handler
+			// which only writes to the pipe returns to it, and it faults again
+			static bool synchronous(int sig)
+			{
+				return sig == SIGSEGV || sig == SIGBUS || sig == SIGFPE || sig == SIGILL;
+			}
+
+			signal_token subscribe(int sig, const signal_info_t& fn, const logger_ptr& log)
+			{
+				if (sig <= 0 || sig >= NSIG || sig == SIGKILL || sig == SIGSTOP || synchronous(sig))
+					return 0;
+
+				std::lock_guard<std::mutex> guard(m_mutex);
+				auto& slot = m_slots[sig];
+				if (!slot.installed && !install(sig, slot))
+					return 0;
+
+				auto token = ++m_next_token;
+				slot.subscribers.push_back({ token, fn, log });
+				return token;
+			}
+
+			// once it returns, the subscriber is neither called nor being called,
+			// so it may take its state away; but for a subscriber unsubscribing
+			// from its own call, which would wait for itself
+			bool unsubscribe(signal_token token)
+			{
+				std::unique_lock<std::mutex> guard(m_mutex);
+				for (int sig = 1; sig < NSIG; ++sig)
+				{
+					auto& slot = m_slots[sig];
+					auto it = std::find_if(slot.subscribers.begin(), slot.subscribers.end(),
+						[token](const subscriber& sub) { return sub.token == token; });
+					if (it == slot.subscribers.end())
+						continue;
+
+					slot.subscribers.erase(it);
+					if (slot.subscribers.empty() && slot.installed)
+					{
+						sigaction(sig, &slot.previous, nullptr);
+						slot.installed = false;
+					}
+
+					if (std::this_thread::get_id() != m_dispatcher)
+						m_called.wait(guard, [this, token] { return m_running != token; });
+					return true;
+				}
+				return false;
+			}
+
+			unsigned long dropped() const { return m_dropped.load(); }
+		};
+
+		registry* registry::s_instance = nullptr;
+
+		class signals : public os::signals
+		{
+			registry& m_registry;
+			logger_ptr m_log;
+			std::mutex m_mutex;
+			std::vector<signal_token> m_tokens;
+			std::map<int, signal_token> m_set; // the subscription, which set() replaces
+			std::mutex m_children_mutex;
+			std::unordered_map<int, int> m_pidfds; // see spawned()
+
+			signal_token track(signal_token token)
+			{
+				if (token)
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_tokens.push_back(token);
+				}
+				return token;
+			}
+
+			static signal_info_t plain(const signal_t& fn)
+			{
+				return [fn](const signal_info&) { fn(); };
+			}
+
+			// with m_children_mutex held, so reaped() cannot close the pidfd meanwhile
+			bool send(int pid, int signo)
+			{
+#if defined(SYS_pidfd_send_signal)
+				auto it = m_pidfds.find(pid);
+				if (it != m_pidfds.end())
+					return !syscall(SYS_pidfd_send_signal, it->second, signo, nullptr, 0);
+#endif
+				return !::kill(pid, signo);
+			}
+
+		public:
+			signals(registry& reg, const logger_ptr& log) : m_registry(reg), m_log(log) {}
+			~signals()
+			{
+				for (auto&& child : m_pidfds)
+					::close(child.second);
+			}
+
 			bool set(const char* sig, const signal_t& fn) override
 			{
-				auto* map = find(sig);
-				if (!map)
+				return set(sig, plain(fn));
+			}
+
+			bool set(const char* sig, const signal_info_t& fn) override
+			{
+				int signo = m_registry.find(sig);
+				if (!signo)
 					return false;
 
-				LOG(s_log) << "Setting " << map->signal << "/" << map->name << "...";
-				map->function = fn;
-				::signal(map->signal, signals::function);
+				LOG(m_log) << "Setting " << signo << "/" << sig << "...";
+
+				auto token = m_registry.subscribe(signo, fn, m_log);
+				if (!token)
+					return false;
+
+				signal_token previous = 0;
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_tokens.push_back(token);
+					auto& current = m_set[signo];
+					previous = current;
+					current = token;
+				}
+
+				// after the new one is in, so the handler is never uninstalled in between
+				if (previous)
+					unsubscribe(previous);
+
 				return true;
 			}
 
+			signal_token subscribe(const char* sig, const signal_t& fn) override
+			{
+				return subscribe(sig, plain(fn));
+			}
+
+			signal_token subscribe(const char* sig, const signal_info_t& fn) override
+			{
+				int signo = m_registry.find(sig);
+				if (!signo)
+					return 0;
+
+				LOG(m_log) << "Subscribing to " << signo << "/" << sig << "...";
+				return track(m_registry.subscribe(signo, fn, m_log));
+			}
+
+			bool unsubscribe(signal_token token) override
+			{
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					auto it = std::find(m_tokens.begin(), m_tokens.end(), token);
+					if (it == m_tokens.end())
+						return false;
+					m_tokens.erase(it);
+				}
+				return m_registry.unsubscribe(token);
+			}
+
 			bool signal(const char* sig, int pid) override
 			{
-				auto* map = find(sig);
-				if (!map)
+				int signo = m_registry.find(sig);
+				if (!signo)
+					return false;
+
+				LOG(m_log) << "Sending " << signo << "/" << sig << " to " << pid << "...";
+				std::lock_guard<std::mutex> guard(m_children_mutex);
+				return send(pid, signo);
+			}
+
+			bool signal_group(const char* sig, int pgid) override
+			{
+				int signo = m_registry.find(sig);
+				if (!signo || pgid <= 0)
 					return false;
 
-				LOG(s_log) << "Sending " << map->signal << "/" << map->name << " to " << pid << "...";
-				return !::kill(pid, map->signal);
+				LOG(m_log) << "Sending " << signo << "/" << sig << " to group " << pgid << "...";
+				return !::kill(-pgid, signo);
+			}
+
+			std::vector<bool> signal(const char* sig, const std::vector<int>& pids) override
+			{
+				std::vector<bool> delivered(pids.size(), false);
+
+				int signo = m_registry.find(sig);
+				if (!signo)
+					return delivered;
+
+				LOG(m_log) << "Sending " << signo << "/" << sig << " to " << pids.size() << " processes...";
+				std::lock_guard<std::mutex> guard(m_children_mutex);
+				for (size_t i = 0; i < pids.size(); ++i)
+					delivered[i] = send(pids[i], signo);
+
+				return delivered;
 			}
 
-			void cleanup()
+			bool queue(const char* sig, int pid, int value) override
 			{
-				s_log.reset();
+				int signo = m_registry.find(sig);
+				if (!signo)
+					return false;
+
+				LOG(m_log) << "Queueing " << signo << "/" << sig << ":" << value << " to " << pid << "...";
+
+				union sigval val;
+				val.sival_int = value;
+				return !sigqueue(pid, signo, val);
+			}
+
+			std::vector<bool> queue(const char* sig, const std::vector<int>& pids, int value) override
+			{
+				std::vector<bool> delivered(pids.size(), false);
+
+				int signo = m_registry.find(sig);
+				if (!signo)
+					return delivered;
+
+				LOG(m_log) << "Queueing " << signo << "/" << sig << ":" << value << " to " << pids.size() << " processes...";
+
+				union sigval val;
+				val.sival_int = value;
+				for (size_t i = 0; i < pids.size(); ++i)
+					delivered[i] = !sigqueue(pids[i], signo, val);
+
+				return delivered;
+			}
+
+			void cleanup() override
+			{
+				std::vector<signal_token> tokens;
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					tokens.swap(m_tokens);
+					m_set.clear();
+				}
+
+				// newest first
+				for (auto it = tokens.rbegin(); it != tokens.rend(); ++it)
+					m_registry.unsubscribe(*it);
+			}
+
+			void spawned(int pid) override
+			{
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+				// nothing reaps the child before reaped(), so this is still the one;
+				// a pidfd is close-on-exec from the start
+				int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+				if (fd < 0)
+					return;
+
+				std::lock_guard<std::mutex> guard(m_children_mutex);
+				auto it = m_pidfds.emplace(pid, fd);
+				if (!it.second)
+				{
+					::close(it.first->second);
+					it.first->second = fd;
+				}
+#else
+				(void)pid;
+#endif
+			}
+
+			void reaped(int pid) override
+			{
+				std::lock_guard<std::mutex> guard(m_children_mutex);
+				auto it = m_pidfds.find(pid);
+				if (it == m_pidfds.end())
+					return;
+				::close(it->second);
+				m_pidfds.erase(it);
 			}
 		};
 	}
@@ -107,8 +557,12 @@ namespace remote
 	{
 		signals_ptr signals::create(const logger_ptr& log)
 		{
-			posix::s_log = log;
-			return std::make_shared<posix::signals>();
+			return std::make_shared<posix::signals>(posix::registry::get(), log);
+		}
+
+		bool signals::known(const char* sig)
+		{
+			return posix::registry::get().find(sig) != 0;
 		}
 	}
 }
@@ -50,21 +50,26 @@ namespace remote
 
 		class Event
 		{
+			using subscriber_t = std::pair<signal_token, signal_t>;
+
 			unique_handle m_handle;
-			signal_t m_function;
+			std::vector<subscriber_t> m_subscribers;
+			signal_token m_set = 0;
 		public:
 			Event() = default;
 			Event(const Event&) = delete;
 			Event& operator = (const Event&) = delete;
 			Event(Event&& oth)
 				: m_handle{ std::move(oth.m_handle) }
-				, m_function{ std::move(oth.m_function) }
+				, m_subscribers{ std::move(oth.m_subscribers) }
+				, m_set{ oth.m_set }
 			{
 			}
 			Event& operator = (Event&& oth)
 			{
 				m_handle = std::move(oth.m_handle);
-				m_function = std::move(oth.m_function);
+				m_subscribers = std::move(oth.m_subscribers);
+				m_set = oth.m_set;
 				return *this;
 			}
 
@@ -94,9 +99,25 @@ namespace remote
 				return EEventResult::OK;
 			}
 
-			void set(const signal_t& fn)
+			void set(signal_token token, const signal_t& fn)
+			{
+				unsubscribe(m_set);
+				m_set = token;
+				subscribe(token, fn);
+			}
+
+			void subscribe(signal_token token, const signal_t& fn)
 			{
-				m_function = fn;
+				m_subscribers.emplace_back(token, fn);
+			}
+
+			bool unsubscribe(signal_token token)
+			{
+				auto it = std::find_if(m_subscribers.begin(), m_subscribers.end(), [token](auto&& sub) { return sub.first == token; });
+				if (it == m_subscribers.end())
+					return false;
+				m_subscribers.erase(it);
+				return true;
 			}
 
 			bool signal()
@@ -104,7 +125,14 @@ namespace remote
 				return SetEvent(m_handle.get()) != FALSE;
 			}
 
-			signal_t call() const { return m_function; }
+			std::vector<signal_t> call() const
+			{
+				std::vector<signal_t> out;
+				out.reserve(m_subscribers.size());
+				for (auto&& sub : m_subscribers)
+					out.push_back(sub.second);
+				return out;
+			}
 			HANDLE get() const { return m_handle.get(); }
 
 			bool operator == (HANDLE h) const
@@ -128,6 +156,7 @@ namespace remote
 			std::string m_op_event;
 			bool        m_shouldStop = false;
 			logger_ptr  m_log;
+			signal_token m_next_token = 0;
 
 			void op(method_t m)
 			{
@@ -173,17 +202,24 @@ namespace remote
 				std::transform(m_events.begin(), m_events.end(), m_waitable.begin(), [](auto&& pair) { return pair.second.get(); });
 			}
 
-			std::string __set(const char* name, const signal_t& fn)
+			std::string __set(const char* name, const signal_t& fn, bool replace = true, signal_token* token = nullptr)
 			{
 				std::lock_guard<std::mutex> guard(m_mutex);
 
+				auto id = ++m_next_token;
+				if (token)
+					*token = id;
+
 				if (name && *name)
 				{
 					auto it = m_events.find(name);
 
 					if (it != m_events.end())
 					{
-						it->second.set(fn);
+						if (replace)
+							it->second.set(id, fn);
+						else
+							it->second.subscribe(id, fn);
 						return it->first;
 					}
 				}
@@ -191,7 +227,10 @@ namespace remote
 				Event ev;
 				if (ev.create(m_log, name) == EEventResult::FAILED)
 					return std::string();
-				ev.set(fn);
+				if (replace)
+					ev.set(id, fn);
+				else
+					ev.subscribe(id, fn);
 
 				std::string _name;
 
@@ -229,7 +268,7 @@ namespace remote
 					if (ret == WAIT_FAILED || ret == WAIT_ABANDONED_0)
 						return;
 
-					signal_t sig;
+					std::vector<signal_t> calls;
 					if (ret < copy.size())
 					{
 						std::lock_guard<std::mutex> guard(m_mutex);
@@ -238,15 +277,15 @@ namespace remote
 						{
 							if (pair.second == handle)
 							{
-								sig = pair.second.call();
+								calls = pair.second.call();
 								break;
 							}
 						}
 						ResetEvent(handle);
 					}
 
-					if (sig)
-						sig();
+					for (auto&& call : calls)
+						call();
 
 				}
 			}
@@ -262,6 +301,12 @@ namespace remote
 			{
 				m_shouldStop = true;
 			}
+
+			// events carry neither the sender nor a value
+			static signal_t plain(const signal_info_t& fn)
+			{
+				return [fn] { fn(signal_info{}); };
+			}
 		public:
 			signals(const logger_ptr& log) : m_log(log)
 			{
@@ -287,6 +332,38 @@ namespace remote
 				return true;
 			}
 
+			bool set(const char* sig, const signal_info_t& fn) override
+			{
+				return set(sig, plain(fn));
+			}
+
+			signal_token subscribe(const char* sig, const signal_info_t& fn) override
+			{
+				return subscribe(sig, plain(fn));
+			}
+
+			signal_token subscribe(const char* sig, const signal_t& fn) override
+			{
+				signal_token token = 0;
+				if (__set(Event::make_name(sig, _getpid()).c_str(), fn, false, &token).empty())
+					return 0;
+
+				op(&signals::update_list);
+
+				return token;
+			}
+
+			bool unsubscribe(signal_token token) override
+			{
+				std::lock_guard<std::mutex> guard(m_mutex);
+				for (auto&& pair : m_events)
+				{
+					if (pair.first != m_op_event && pair.second.unsubscribe(token))
+						return true;
+				}
+				return false;
+			}
+
 			bool signal(const char* sig, int pid) override
 			{
 				Event ev;
@@ -295,6 +372,31 @@ namespace remote
 
 				return false;
 			}
+
+			bool signal_group(const char*, int) override
+			{
+				// there are no process groups to broadcast to
+				return false;
+			}
+
+			std::vector<bool> signal(const char* sig, const std::vector<int>& pids) override
+			{
+				std::vector<bool> delivered(pids.size(), false);
+				for (size_t i = 0; i < pids.size(); ++i)
+					delivered[i] = signal(sig, pids[i]);
+				return delivered;
+			}
+
+			bool queue(const char*, int, int) override
+			{
+				// an event cannot queue, nor carry the value
+				return false;
+			}
+
+			std::vector<bool> queue(const char*, const std::vector<int>& pids, int) override
+			{
+				return std::vector<bool>(pids.size(), false);
+			}
 		};
 
 	}
@@ -305,5 +407,11 @@ namespace remote
 		{
 			return std::make_shared<win32::signals>(std::forward<const logger_ptr&>(log));
 		}
+
+		bool signals::known(const char* sig)
+		{
+			// any name makes a named event
+			return sig && *sig;
+		}
 	}
 }
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/simulation.hpp>
+#include <signal.h>
+
+namespace remote
+{
+	// what the supervisor gets from create_signals(): its handlers are kept
+	// for raise(), what it sends goes to the simulated workers
+	struct simulation::handlers : os::signals
+	{
+		simulation* sim;
+		std::map<std::string, std::vector<std::pair<signal_token, signal_info_t>>> subscribers;
+		signal_token next_token = 0;
+
+		explicit handlers(simulation* sim) : sim(sim) {}
+
+		bool set(const char* sig, const signal_t& fn) override
+		{
+			return set(sig, [fn](const signal_info&) { fn(); });
+		}
+
+		bool set(const char* sig, const signal_info_t& fn) override
+		{
+			auto& list = subscribers[sig];
+			list.clear();
+			list.emplace_back(++next_token, fn);
+			return true;
+		}
+
+		signal_token subscribe(const char* sig, const signal_t& fn) override
+		{
+			return subscribe(sig, [fn](const signal_info&) { fn(); });
+		}
+
+		signal_token subscribe(const char* sig, const signal_info_t& fn) override
+		{
+			subscribers[sig].emplace_back(++next_token, fn);
+			return next_token;
+		}
+
+		bool unsubscribe(signal_token token) override
+		{
+			for (auto&& pair : subscribers)
+			{
+				auto& list = pair.second;
+				for (auto it = list.begin(); it != list.end(); ++it)
+				{
+					if (it->first != token)
+						continue;
+					list.erase(it);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool signal(const char* sig, int pid) override
+		{
+			bool found = false;
+			if (sim)
+				sim->deliver(sig, pid, found);
+			return found;
+		}
+
+		bool signal_group(const char* sig, int pgid) override
+		{
+			if (!sim)
+				return false;
+
+			std::vector<int> members;
+			for (auto&& pair : sim->m_processes)
+			{
+				if (pair.second.group == pgid && !pair.second.exited)
+					members.push_back(pair.first);
+			}
+
+			bool found = false;
+			for (auto pid : members)
+				sim->deliver(sig, pid, found);
+			return found;
+		}
+
+		std::vector<bool> signal(const char* sig, const std::vector<int>& pids) override
+		{
+			std::vector<bool> out;
+			out.reserve(pids.size());
+			for (auto pid : pids)
+				out.push_back(signal(sig, pid));
+			return out;
+		}
+
+		bool queue(const char* sig, int pid, int) override { return signal(sig, pid); }
+
+		std::vector<bool> queue(const char* sig, const std::vector<int>& pids, int) override
+		{
+			return signal(sig, pids);
+		}
+	};
+
+	simulation::simulation(const simulation_config& config)
+		: m_config(config)
+		, m_random(config.seed)
+		, m_handlers(std::make_shared<handlers>(this))
+	{
+		// far enough from the epoch, so a zero time_point stays "never"
+		m_start = m_now = clock::time_point{} + std::chrono::hours{ 1 };
+	}
+
+	simulation::~simulation()
+	{
+		m_handlers->sim = nullptr;
+	}
+
+	bool simulation::chance(double p)
+	{
+		return p > 0 && std::uniform_real_distribution<double>{ 0, 1 }(m_random) < p;
+	}
+
+	void simulation::exit_at(int pid, clock::time_point when, int status)
+	{
+		m_events.push(event{ when, m_next_event++, pid, status });
+	}
+
+	void simulation::run_events()
+	{
+		while (!m_events.empty() && m_events.top().time <= m_now)
+		{
+			auto next = m_events.top();
+			m_events.pop();
+
+			// the first of the exits scheduled for a worker wins
+			auto it = m_processes.find(next.pid);
+			if (it == m_processes.end() || it->second.exited)
+				continue;
+
+			it->second.exited = true;
+			m_exited.emplace_back(next.pid, next.status);
+			++m_counters.exited;
+		}
+	}
+
+	void simulation::deliver(const char* sig, int pid, bool& found)
+	{
+		++m_counters.signals;
+
+		auto it = m_processes.find(pid);
+		if (it == m_processes.end() || it->second.exited)
+			return;
+		found = true;
+
+		std::string name = sig;
+		if (name == "SIGKILL" || name == "kill")
+			terminate(pid, true);
+		else if (name == "SIGTERM" || name == "term" || name == "stop")
+			terminate(pid, false);
+		// anything else is taken and ignored
+	}
+
+	void simulation::wait(output_capture&, std::chrono::milliseconds timeout)
+	{
+		auto real = std::chrono::steady_clock::now();
+		++m_counters.ticks;
+		if (on_tick && m_woke != std::chrono::steady_clock::time_point{})
+			on_tick(real - m_woke);
+
+		auto until = m_now + timeout;
+		while (!m_script.empty() && m_script.begin()->first <= until)
+		{
+			auto next = m_script.begin();
+			auto fn = std::move(next->second);
+			m_now = std::max(m_now, next->first);
+			m_script.erase(next);
+			fn(*this);
+		}
+		m_now = until;
+
+		m_woke = std::chrono::steady_clock::now();
+	}
+
+	// the simulated workers have no control channels
+	bool simulation::watch(int) { return false; }
+	void simulation::unwatch(int) {}
+
+	os::signals_ptr simulation::create_signals(const logger_ptr&)
+	{
+		return m_handlers;
+	}
+
+	int simulation::listen(const std::string&)
+	{
+		return m_next_socket++;
+	}
+
+	void simulation::close(int) {}
+
+	int simulation::spawn(int, const spawn_template& tmpl)
+	{
+		m_now += m_config.spawn_time;
+
+		if (chance(m_config.spawn_failure))
+		{
+			++m_counters.spawn_failed;
+			return -1;
+		}
+
+		auto pid = m_next_pid++;
+		auto& proc = m_processes[pid];
+		proc.group = tmpl.process_group < 0 ? 1 : tmpl.process_group ? tmpl.process_group : pid;
+		proc.ignores_term = chance(m_config.ignore_term);
+		++m_counters.spawned;
+
+		if (m_config.mean_lifetime.count())
+		{
+			std::exponential_distribution<double> lifetime{ 1.0 / (double)m_config.mean_lifetime.count() };
+			auto ms = std::chrono::milliseconds{ (long long)lifetime(m_random) };
+			exit_at(pid, m_now + ms, 1);
+		}
+
+		return pid;
+	}
+
+	int simulation::reap(int& status)
+	{
+		run_events();
+		if (m_exited.empty())
+			return 0;
+
+		// in the order they exited
+		auto next = m_exited.front();
+		m_exited.pop_front();
+		m_processes.erase(next.first);
+		++m_counters.reaped;
+
+		status = next.second;
+		return next.first;
+	}
+
+	bool simulation::terminate(int pid, bool force)
+	{
+		auto it = m_processes.find(pid);
+		if (it == m_processes.end() || it->second.exited)
+			return false;
+
+		if (force)
+		{
+			++m_counters.killed;
+			exit_at(pid, m_now, 128 + SIGKILL);
+		}
+		else
+		{
+			++m_counters.terminated;
+			if (!it->second.ignores_term)
+				exit_at(pid, m_now + m_config.term_delay, 128 + SIGTERM);
+		}
+		return true;
+	}
+
+	int simulation::process_group(int pid)
+	{
+		auto it = m_processes.find(pid);
+		return it == m_processes.end() ? 0 : it->second.group;
+	}
+
+	void simulation::at(std::chrono::milliseconds when, const action& fn)
+	{
+		m_script.emplace(m_start + when, fn);
+	}
+
+	void simulation::raise(const char* sig)
+	{
+		auto it = m_handlers->subscribers.find(sig);
+		if (it == m_handlers->subscribers.end())
+			return;
+
+		signal_info info;
+		info.sender = 1;
+
+		// a copy: a handler may subscribe or unsubscribe
+		auto list = it->second;
+		for (auto&& pair : list)
+			pair.second(info);
+	}
+
+	bool simulation::crash(int pid, int status)
+	{
+		auto it = m_processes.find(pid);
+		if (it == m_processes.end() || it->second.exited)
+			return false;
+
+		exit_at(pid, m_now, status);
+		return true;
+	}
+
+	size_t simulation::crash(double share, int status)
+	{
+		// sorted, so the same seed picks the same workers
+		std::vector<int> pids;
+		pids.reserve(m_processes.size());
+		for (auto&& pair : m_processes)
+		{
+			if (!pair.second.exited)
+				pids.push_back(pair.first);
+		}
+		std::sort(pids.begin(), pids.end());
+
+		size_t crashed = 0;
+		for (auto pid : pids)
+		{
+			if (chance(share) && crash(pid, status))
+				++crashed;
+		}
+		return crashed;
+	}
+
+	size_t simulation::running() const
+	{
+		size_t count = 0;
+		for (auto&& pair : m_processes)
+			count += !pair.second.exited;
+		return count;
+	}
+
+	std::chrono::milliseconds simulation::elapsed() const
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(m_now - m_start);
+	}
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/state.hpp>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace remote
+{
+	namespace
+	{
+		size_t file_size(size_t pools, size_t workers)
+		{
+			return sizeof(state_layout::header) + pools * sizeof(state_layout::pool) + workers * sizeof(state_layout::worker);
+		}
+
+		int64_t now_ms()
+		{
+			using namespace std::chrono;
+			return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	state_file::state_file(const std::string& path, size_t pools, size_t workers, int64_t started)
+		: m_path(path)
+	{
+#ifndef _WIN32
+		m_size = file_size(pools, workers);
+
+		// readers must never map a file without a header, so the new one
+		// is prepared under a temporary name and renamed into place
+		auto temp = path + ".tmp";
+		m_fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (m_fd < 0)
+			return;
+
+		void* data = MAP_FAILED;
+		if (!ftruncate(m_fd, m_size))
+			data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+		if (data == MAP_FAILED)
+		{
+			::close(m_fd);
+			m_fd = -1;
+			unlink(temp.c_str());
+			return;
+		}
+
+		auto hdr = new (data) state_layout::header;
+		hdr->magic = state_layout::magic;
+		hdr->version = state_layout::version;
+		hdr->pool_capacity = (uint32_t)pools;
+		hdr->worker_capacity = (uint32_t)workers;
+		hdr->sequence.store(0);
+		hdr->supervisor = _getpid();
+		hdr->started = started ? started : now_ms();
+		hdr->pools = 0;
+		hdr->workers = 0;
+
+		if (rename(temp.c_str(), path.c_str()))
+		{
+			munmap(data, m_size);
+			::close(m_fd);
+			m_fd = -1;
+			unlink(temp.c_str());
+			return;
+		}
+
+		m_data = data;
+#endif
+	}
+
+	state_file::~state_file()
+	{
+#ifndef _WIN32
+		if (m_data)
+		{
+			munmap(m_data, m_size);
+
+			// not, if a bigger file was renamed over it already
+			struct stat own, current;
+			if (!fstat(m_fd, &own) && !stat(m_path.c_str(), &current) && own.st_dev == current.st_dev && own.st_ino == current.st_ino)
+				unlink(m_path.c_str());
+		}
+		if (m_fd >= 0)
+			::close(m_fd);
+#endif
+	}
+
+	void state_file::begin()
+	{
+		header()->sequence.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void state_file::commit()
+	{
+		header()->sequence.fetch_add(1, std::memory_order_release);
+	}
+
+	state_layout::pool* state_file::pools() const
+	{
+		return (state_layout::pool*)((char*)m_data + sizeof(state_layout::header));
+	}
+
+	state_layout::worker* state_file::workers() const
+	{
+		return (state_layout::worker*)((char*)m_data + sizeof(state_layout::header) + header()->pool_capacity * sizeof(state_layout::pool));
+	}
+
+	void state_file::counts(size_t pools, size_t workers)
+	{
+		header()->pools = (uint32_t)pools;
+		header()->workers = (uint32_t)workers;
+	}
+
+	std::string state_file::path_for(const std::string& pid_path)
+	{
+		static const char ext[] = ".pid";
+		static const size_t ext_len = sizeof(ext) - 1;
+
+		if (pid_path.length() > ext_len && !pid_path.compare(pid_path.length() - ext_len, ext_len, ext))
+			return pid_path.substr(0, pid_path.length() - ext_len) + ".state";
+		return pid_path + ".state";
+	}
+
+	bool state_file::read(const std::string& path, state_snapshot& out)
+	{
+#ifdef _WIN32
+		return false;
+#else
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) || (size_t)st.st_size < sizeof(state_layout::header))
+		{
+			::close(fd);
+			return false;
+		}
+
+		size_t size = st.st_size;
+		void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return false;
+
+		auto hdr = (const state_layout::header*)data;
+		bool ok = hdr->magic == state_layout::magic && hdr->version == state_layout::version
+			&& file_size(hdr->pool_capacity, hdr->worker_capacity) <= size;
+
+		auto pool_table = (const state_layout::pool*)((const char*)data + sizeof(state_layout::header));
+		auto worker_table = (const state_layout::worker*)((const char*)data + sizeof(state_layout::header) + (ok ? hdr->pool_capacity : 0) * sizeof(state_layout::pool));
+
+		// a writer which died between begin() and commit() leaves the
+		// sequence odd for good; give up on it rather than wait forever
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (ok)
+		{
+			auto before = hdr->sequence.load(std::memory_order_acquire);
+			if (before & 1)
+			{
+				if (std::chrono::steady_clock::now() > deadline)
+				{
+					ok = false;
+					break;
+				}
+				std::this_thread::yield();
+				continue;
+			}
+
+			out.supervisor = hdr->supervisor;
+			out.started = hdr->started;
+
+			size_t pools = std::min(hdr->pools, hdr->pool_capacity);
+			size_t workers = std::min(hdr->workers, hdr->worker_capacity);
+			out.pools.assign(pool_table, pool_table + pools);
+			out.workers.assign(worker_table, worker_table + workers);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (hdr->sequence.load(std::memory_order_relaxed) == before)
+				break;
+			if (std::chrono::steady_clock::now() > deadline)
+				ok = false;
+		}
+
+		munmap(data, size);
+		return ok;
+#endif
+	}
+}
@@ -0,0 +1,999 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/supervisor.hpp>
+#include <remote/respawn.hpp>
+#include <remote/identity.hpp>
+#include <fstream>
+#include <unordered_map>
+
+namespace remote
+{
+	namespace
+	{
+		using clock = std::chrono::steady_clock;
+
+		std::string trim(const std::string& str)
+		{
+			auto begin = str.find_first_not_of(" \t\r");
+			if (begin == std::string::npos)
+				return std::string();
+			auto end = str.find_last_not_of(" \t\r");
+			return str.substr(begin, end - begin + 1);
+		}
+
+		// splits the command line on whitespace, honouring "..." and '...'
+		bool split_args(const std::string& line, std::vector<std::string>& out)
+		{
+			out.clear();
+
+			std::string arg;
+			bool in_arg = false;
+			char quote = 0;
+			for (size_t i = 0; i < line.length(); ++i)
+			{
+				char c = line[i];
+				if (quote)
+				{
+					if (c == quote)
+						quote = 0;
+					else if (c == '\\' && quote == '"' && i + 1 < line.length())
+						arg.push_back(line[++i]);
+					else
+						arg.push_back(c);
+					continue;
+				}
+
+				switch (c)
+				{
+				case ' ': case '\t':
+					if (in_arg)
+						out.push_back(arg);
+					arg.clear();
+					in_arg = false;
+					break;
+				case '"': case '\'':
+					quote = c;
+					in_arg = true;
+					break;
+				default:
+					arg.push_back(c);
+					in_arg = true;
+				}
+			}
+
+			if (quote)
+				return false;
+
+			if (in_arg)
+				out.push_back(arg);
+
+			return !out.empty();
+		}
+
+		bool to_number(const std::string& value, unsigned long long& out)
+		{
+			if (value.empty())
+				return false;
+
+			out = 0;
+			for (auto&& c : value)
+			{
+				if (c < '0' || c > '9')
+					return false;
+				out = out * 10 + (c - '0');
+			}
+			return true;
+		}
+
+		// LOG_LIMIT() keeps one limit per call site, so a pool in a crash loop would
+		// hold back the lines of all the others; these are per pool and site. Never
+		// freed, log_suppressed() keeps every limit which held a line back
+		log_limit& pool_limit(const std::string& pool, int line)
+		{
+			static std::mutex mutex;
+			static std::map<std::pair<std::string, int>, log_limit*> limits;
+
+			std::lock_guard<std::mutex> guard(mutex);
+			auto& limit = limits[{ pool, line }];
+			if (!limit)
+				limit = new log_limit{ __FILE__, line };
+			return *limit;
+		}
+
+		bool to_bool(const std::string& value, bool& out)
+		{
+			if (value == "yes" || value == "true" || value == "on" || value == "1")
+				out = true;
+			else if (value == "no" || value == "false" || value == "off" || value == "0")
+				out = false;
+			else
+				return false;
+			return true;
+		}
+	}
+
+	bool pool_config::same_spawn(const pool_config& oth) const
+	{
+		return address == oth.address
+			&& args == oth.args
+			&& env == oth.env
+			&& user == oth.user
+			&& group == oth.group
+			&& limits == oth.limits;
+	}
+
+	bool supervisor_config::load(const logger_ptr& log, const std::string& path, supervisor_config& out)
+	{
+		std::ifstream in{ path };
+		if (!in)
+		{
+			LOG(log) << path << ": cannot open the configuration";
+			return false;
+		}
+
+		supervisor_config config;
+		pool_config* pool = nullptr;
+		bool ok = true;
+
+		auto error = [&](size_t line, const std::string& msg)
+		{
+			LOG(log) << path << ':' << line << ": " << msg;
+			ok = false;
+		};
+
+		std::string text;
+		size_t lineno = 0;
+		while (std::getline(in, text))
+		{
+			++lineno;
+
+			auto line = trim(text);
+			if (line.empty() || line[0] == '#' || line[0] == ';')
+				continue;
+
+			if (line[0] == '[')
+			{
+				if (line[line.length() - 1] != ']')
+				{
+					error(lineno, "unterminated section name");
+					continue;
+				}
+
+				auto name = trim(line.substr(1, line.length() - 2));
+				if (name.empty())
+				{
+					error(lineno, "empty pool name");
+					continue;
+				}
+
+				for (auto&& prev : config.pools)
+				{
+					if (prev.name == name)
+						error(lineno, "pool '" + name + "' defined twice");
+				}
+
+				config.pools.emplace_back();
+				pool = &config.pools.back();
+				pool->name = name;
+				continue;
+			}
+
+			auto eq = line.find('=');
+			if (eq == std::string::npos)
+			{
+				error(lineno, "expected 'key = value'");
+				continue;
+			}
+
+			if (!pool)
+			{
+				error(lineno, "setting outside of a [pool] section");
+				continue;
+			}
+
+			auto key = trim(line.substr(0, eq));
+			auto value = trim(line.substr(eq + 1));
+			unsigned long long number = 0;
+
+			if (key == "address")
+				pool->address = value;
+			else if (key == "exec")
+			{
+				if (!split_args(value, pool->args))
+					error(lineno, "cannot parse the command line");
+			}
+			else if (key == "env")
+			{
+				if (value.find('=') == std::string::npos)
+					error(lineno, "expected 'env = NAME=value'");
+				else
+					pool->env.push_back(value);
+			}
+			else if (key == "workers")
+			{
+				if (!to_number(value, number) || !number)
+					error(lineno, "workers must be a positive number");
+				else
+					pool->workers = (size_t)number;
+			}
+			else if (key == "user")
+				pool->user = value;
+			else if (key == "group")
+				pool->group = value;
+			else if (key == "control")
+			{
+				if (!to_bool(value, pool->control))
+					error(lineno, "control must be yes or no");
+			}
+			else if (key == "output")
+			{
+				if (value == "log")
+					pool->output.to = output_config::target::logger;
+				else if (value == "none")
+					pool->output.to = output_config::target::discard;
+				else
+				{
+					pool->output.to = output_config::target::file;
+					pool->output.path = value;
+				}
+			}
+			else if (key == "output.pipe_size")
+			{
+				if (!to_number(value, number) || !number)
+					error(lineno, "output.pipe_size must be a positive number");
+				else
+					pool->output.pipe_size = (size_t)number;
+			}
+			else if (key == "watchdog")
+			{
+				if (!to_number(value, number))
+					error(lineno, "watchdog must be a number of milliseconds");
+				else
+					pool->watchdog.timeout = std::chrono::milliseconds{ number };
+			}
+			else if (key == "watchdog.grace")
+			{
+				if (!to_number(value, number))
+					error(lineno, "watchdog.grace must be a number of milliseconds");
+				else
+					pool->watchdog.grace = std::chrono::milliseconds{ number };
+			}
+			else if (key == "watchdog.signal")
+			{
+				if (!os::signals::known(value.c_str()))
+					error(lineno, "unknown signal '" + value + "'");
+				else
+					pool->watchdog.signal = value;
+			}
+			else if (!key.compare(0, 6, "limit."))
+			{
+				auto name = key.substr(6);
+				if (!os::limit_known(name))
+					error(lineno, "unknown limit '" + name + "'");
+				else if (!to_number(value, number))
+					error(lineno, "limit must be a number");
+				else
+					pool->limits[name] = number;
+			}
+			else
+				error(lineno, "unknown setting '" + key + "'");
+		}
+
+		for (auto&& p : config.pools)
+		{
+			// the heartbeats come through the control channel
+			if (p.watchdog.timeout.count())
+				p.control = true;
+
+			if (p.args.empty())
+			{
+				LOG(log) << path << ": pool '" << p.name << "' has no exec line";
+				ok = false;
+			}
+			if (p.address.empty())
+			{
+				LOG(log) << path << ": pool '" << p.name << "' has no address";
+				ok = false;
+			}
+		}
+
+		if (ok)
+			out = std::move(config);
+
+		return ok;
+	}
+
+	struct supervisor::pool_state
+	{
+		struct worker
+		{
+			int pid = 0;
+			uint32_t generation = 0;
+			clock::time_point started;
+			clock::time_point next_start;
+			std::shared_ptr<control_channel> control;
+			clock::time_point heartbeat;  // the last one to come up the control channel
+			clock::time_point dumped;     // when the watchdog signalled it, or zero
+			bool hung = false;            // killed by the watchdog, waiting to be reaped
+		};
+
+		pool_config config;
+		uint32_t generation = 0;
+		int process_group = 0;      // all workers of a pool share one, so a single kill() reaches them all
+		std::shared_ptr<const credentials> identity;
+		int listener = -1;
+		bool waiting = false;       // for the workers of a stopped pool to free the address
+		clock::time_point retry_until; // after they did, the listen is retried until then
+		std::vector<worker> workers;
+
+		spawn_template make_template() const
+		{
+			spawn_template tmpl;
+			tmpl.args = config.args;
+			tmpl.env = config.env;
+			tmpl.identity = identity;
+			tmpl.limits = config.limits;
+			tmpl.process_group = process_group;
+			return tmpl;
+		}
+	};
+
+	// a worker no pool slot tracks any more: terminated, killed after
+	// stop_timeout, and holding on to its pool's listener until reaped
+	struct supervisor::draining
+	{
+		int pid;
+		std::string address;
+		clock::time_point deadline;
+		bool killed = false;
+	};
+
+	supervisor::supervisor(const logger_ptr& log, const std::string& path, const os::backend_ptr& backend)
+		: m_log(log)
+		, m_path(path)
+		, m_os(backend ? backend : os::native())
+		, m_signals(m_os->create_signals(log))
+		, m_output(log)
+	{
+	}
+
+	supervisor::~supervisor()
+	{
+		shutdown();
+	}
+
+	bool supervisor::start_pool(pool_state& pool)
+	{
+		pool.identity.reset();
+		if (!pool.config.user.empty())
+		{
+			// already in the cache, filled by apply()
+			auto creds = std::make_shared<credentials>();
+			if (resolve_identity(pool.config.user.c_str(), pool.config.group.c_str(), *creds) != identity::ok)
+				return false;
+			pool.identity = creds;
+		}
+
+		if (pool.listener < 0)
+		{
+			// bound again by drain(), once the old workers are gone
+			pool.waiting = draining_on(pool.config.address);
+			if (pool.waiting)
+			{
+				LOG(m_log) << '[' << pool.config.name << "] waiting for the old workers to free " << pool.config.address;
+				return false;
+			}
+
+			try
+			{
+				pool.listener = m_os->listen(pool.config.address);
+			}
+			catch (spawn_error& err)
+			{
+				// what the old workers started may hold the listener a little longer
+				if (m_os->now() < pool.retry_until)
+				{
+					pool.waiting = true;
+					return false;
+				}
+				LOG(m_log) << '[' << pool.config.name << "] " << err.what();
+				return false;
+			}
+		}
+
+		++pool.generation;
+		pool.process_group = 0;
+		pool.workers.resize(pool.config.workers);
+		fill_pool(pool);
+		return true;
+	}
+
+	void supervisor::stop_pool(pool_state& pool)
+	{
+		for (auto&& worker : pool.workers)
+		{
+			if (worker.pid > 0)
+				retire(pool, worker.pid);
+		}
+		pool.workers.clear();
+		m_dirty = true;
+	}
+
+	void supervisor::retire(const pool_state& pool, int pid)
+	{
+		m_os->terminate(pid, false);
+		m_draining.push_back({ pid, pool.config.address, m_os->now() + stop_timeout });
+	}
+
+	bool supervisor::draining_on(const std::string& address) const
+	{
+		for (auto&& worker : m_draining)
+		{
+			if (worker.address == address)
+				return true;
+		}
+		return false;
+	}
+
+	void supervisor::drain()
+	{
+		auto now = m_os->now();
+		for (auto&& worker : m_draining)
+		{
+			if (worker.killed || now < worker.deadline)
+				continue;
+			m_os->terminate(worker.pid, true);
+			worker.killed = true;
+		}
+
+		for (auto&& pair : m_pools)
+		{
+			auto& pool = *pair.second;
+			if (!pool.waiting || draining_on(pool.config.address))
+				continue;
+
+			if (pool.retry_until == clock::time_point{})
+				pool.retry_until = now + stop_timeout;
+			if (start_pool(pool))
+				pool.retry_until = clock::time_point{};
+		}
+	}
+
+	void supervisor::fill_pool(pool_state& pool)
+	{
+		if (pool.listener < 0)
+			return;
+
+		auto now = m_os->now();
+		spawn_template tmpl;
+		bool prepared = false;
+
+		for (auto&& worker : pool.workers)
+		{
+			if (worker.pid > 0 || now < worker.next_start)
+				continue;
+
+			if (!prepared)
+			{
+				tmpl = pool.make_template();
+				prepared = true;
+			}
+
+			if (pool.config.control)
+			{
+				// the doorbell leaves the backend's wait() together with the channel,
+				// wherever the worker's slot drops it
+				auto os = m_os;
+				worker.control.reset(new control_channel(64), [os](control_channel* channel) {
+					if (*channel)
+						os->unwatch(channel->wake_fd());
+					delete channel;
+				});
+				if (!*worker.control)
+				{
+					worker.control.reset();
+					worker.next_start = now + restart_delay;
+					LOG(m_log) << '[' << pool.config.name << "] could not create a control channel";
+					continue;
+				}
+
+				// a heartbeat or a message wakes the supervisor up, before the tick is over
+				if (m_os->watch(worker.control->wake_fd()))
+					worker.control->arm();
+			}
+
+			output_pipe output;
+			bool captured = m_output.open(pool.config.output, output);
+
+			if (worker.control || captured)
+			{
+				auto own = tmpl;
+				if (worker.control)
+				{
+					own.env.push_back(worker.control->env());
+					for (auto fd : worker.control->fds())
+						own.inherit.push_back(fd);
+				}
+				own.output = output.write;
+				worker.pid = m_os->spawn(pool.listener, own);
+			}
+			else
+				worker.pid = m_os->spawn(pool.listener, tmpl);
+
+			m_output.attach(worker.pid, output, pool.config.output, pool.config.name);
+			worker.generation = pool.generation;
+			worker.started = now;
+			worker.heartbeat = now;
+			worker.dumped = clock::time_point{};
+			worker.hung = false;
+			m_dirty = true;
+
+			// either the first worker, or the previous group died out
+			if (worker.pid > 0)
+			{
+				auto group = m_os->process_group(worker.pid);
+				if (group && group != pool.process_group)
+				{
+					pool.process_group = group;
+					tmpl.process_group = group;
+				}
+			}
+			if (worker.pid < 0)
+			{
+				worker.pid = 0;
+				worker.control.reset();
+				worker.next_start = now + restart_delay;
+				LOG_LIMIT_ON(m_log, pool_limit(pool.config.name, __LINE__), 1, 10) << '[' << pool.config.name << "] could not start " << pool.config.args[0];
+			}
+		}
+	}
+
+	void supervisor::reap()
+	{
+		// all the exits first, then one pass over the workers: a shutdown of
+		// thousands would be quadratic with a search per pid
+		std::unordered_map<int, int> exited;
+		int status = 0;
+		int pid;
+		while ((pid = m_os->reap(status)) > 0)
+			exited[pid] = status;
+
+		if (exited.empty())
+			return;
+
+		auto now = m_os->now();
+		for (auto&& pair : m_pools)
+		{
+			auto& pool = *pair.second;
+			for (auto&& worker : pool.workers)
+			{
+				auto it = worker.pid > 0 ? exited.find(worker.pid) : exited.end();
+				if (it == exited.end())
+					continue;
+				auto exit = *it;
+				exited.erase(it);
+
+				worker.pid = 0;
+				worker.control.reset();
+				m_dirty = true;
+
+				// a worker which dies right after the start is not respawned right away
+				if (now - worker.started < restart_delay)
+					worker.next_start = worker.started + restart_delay;
+				else
+					worker.next_start = now;
+
+				// a pool in a crash loop would flood the log otherwise
+				LOG_LIMIT_ON(m_log, pool_limit(pool.config.name, __LINE__), 10, 50) << '[' << pool.config.name << "] worker " << exit.first << " exited with status " << exit.second;
+			}
+		}
+
+		// what is left was not in a slot any more
+		if (!exited.empty())
+		{
+			m_draining.erase(std::remove_if(m_draining.begin(), m_draining.end(),
+				[&](const draining& worker) { return exited.count(worker.pid) != 0; }), m_draining.end());
+		}
+	}
+
+	void supervisor::receive()
+	{
+		control_message msg;
+		for (auto&& pair : m_pools)
+		{
+			// not the pool's control setting: a reload may have turned it off
+			// under workers which still have their channels
+			auto& pool = *pair.second;
+			for (auto&& worker : pool.workers)
+			{
+				if (!worker.control)
+					continue;
+
+				// re-armed for the next wait(), unless more came meanwhile
+				do
+				{
+					while (worker.control->receive(msg))
+					{
+						if (msg.type == control_message::heartbeat)
+							worker.heartbeat = m_os->now();
+						else if (on_message)
+							on_message(pool.config.name, worker.pid, msg);
+					}
+				} while (!worker.control->arm());
+			}
+		}
+	}
+
+	void supervisor::watch()
+	{
+		auto now = m_os->now();
+		for (auto&& pair : m_pools)
+		{
+			auto& pool = *pair.second;
+			auto& dog = pool.config.watchdog;
+			if (!dog.timeout.count())
+				continue;
+
+			for (auto&& worker : pool.workers)
+			{
+				if (worker.pid <= 0 || !worker.control || worker.hung)
+					continue;
+
+				auto beat = std::max(worker.heartbeat, worker.control->last_beat());
+				if (now - beat < dog.timeout)
+				{
+					worker.dumped = clock::time_point{};
+					continue;
+				}
+
+				if (worker.dumped == clock::time_point{})
+				{
+					worker.dumped = now;
+					LOG(m_log) << '[' << pool.config.name << "] worker " << worker.pid << " missed its heartbeat for "
+						<< std::chrono::duration_cast<std::chrono::milliseconds>(now - beat).count() << "ms, sending " << dog.signal;
+					if (!m_signals.signal(dog.signal.c_str(), worker.pid))
+						LOG(m_log) << '[' << pool.config.name << "] could not send " << dog.signal << " to " << worker.pid;
+					continue;
+				}
+
+				if (now - worker.dumped < dog.grace)
+					continue;
+
+				// reap() respawns it; it lived long enough not to wait for restart_delay
+				LOG(m_log) << '[' << pool.config.name << "] worker " << worker.pid << " is hung, replacing it";
+				m_os->terminate(worker.pid, true);
+				worker.hung = true;
+			}
+		}
+	}
+
+	size_t supervisor::send(const std::string& name, const control_message& msg)
+	{
+		auto it = m_pools.find(name);
+		if (it == m_pools.end())
+			return 0;
+
+		size_t sent = 0;
+		for (auto&& worker : it->second->workers)
+		{
+			if (worker.pid > 0 && worker.control && worker.control->send(msg))
+				++sent;
+		}
+		return sent;
+	}
+
+	size_t supervisor::signal(const std::string& name, const char* sig)
+	{
+		auto it = m_pools.find(name);
+		if (it == m_pools.end())
+			return 0;
+
+		auto& pool = *it->second;
+		std::vector<int> pids;
+		for (auto&& worker : pool.workers)
+		{
+			if (worker.pid > 0)
+				pids.push_back(worker.pid);
+		}
+		if (pids.empty())
+			return 0;
+
+		if (pool.process_group > 0)
+			return m_signals.signal_group(sig, pool.process_group) ? pids.size() : 0;
+
+		auto delivered = m_signals.signal(sig, pids);
+		return (size_t)std::count(delivered.begin(), delivered.end(), true);
+	}
+
+	void supervisor::apply(supervisor_config& config)
+	{
+		// every user and group is looked up once per (re)load; the workers
+		// get the ready credentials and switch to them before exec
+		forget_identities();
+		for (auto&& conf : config.pools)
+		{
+			if (conf.user.empty())
+				continue;
+
+			credentials creds;
+			auto ret = resolve_identity(conf.user.c_str(), conf.group.c_str(), creds);
+			if (ret != identity::ok)
+				LOG(m_log) << '[' << conf.name << "] cannot resolve " << conf.user << (conf.group.empty() ? "" : ":") << conf.group << " (" << (int)ret << ')';
+		}
+
+		// pools gone from the config go first; a pool taking over one of their
+		// addresses waits in start_pool() until the old workers have exited
+		for (auto it = m_pools.begin(); it != m_pools.end();)
+		{
+			bool found = false;
+			for (auto&& conf : config.pools)
+				found |= conf.name == it->first;
+
+			if (found)
+			{
+				++it;
+				continue;
+			}
+
+			LOG(m_log) << '[' << it->first << "] stopping";
+			stop_pool(*it->second);
+			if (it->second->listener >= 0)
+				m_os->close(it->second->listener);
+			it = m_pools.erase(it);
+		}
+
+		pools_t next;
+
+		for (auto&& conf : config.pools)
+		{
+			auto it = m_pools.find(conf.name);
+			if (it == m_pools.end())
+			{
+				LOG(m_log) << '[' << conf.name << "] starting";
+				std::unique_ptr<pool_state> pool{ new pool_state };
+				pool->config = conf;
+				start_pool(*pool);
+				next[conf.name] = std::move(pool);
+				continue;
+			}
+
+			auto pool = std::move(it->second);
+			m_pools.erase(it);
+
+			if (pool->config.same_spawn(conf))
+			{
+				// neither the watchdog, the control channel nor the output change the way
+				// the workers are spawned; the running workers keep what they were started
+				// with (watch() passes over those without a channel), the ones started from
+				// now on get the new settings
+				pool->config.watchdog = conf.watchdog;
+				pool->config.control = conf.control;
+				pool->config.output = conf.output;
+
+				if (pool->config.workers != conf.workers)
+				{
+					LOG(m_log) << '[' << conf.name << "] resizing from " << pool->config.workers << " to " << conf.workers;
+					for (size_t i = conf.workers; i < pool->workers.size(); ++i)
+					{
+						if (pool->workers[i].pid > 0)
+							retire(*pool, pool->workers[i].pid);
+					}
+					pool->config.workers = conf.workers;
+					pool->workers.resize(conf.workers);
+					m_dirty = true;
+					fill_pool(*pool);
+				}
+				next[conf.name] = std::move(pool);
+				continue;
+			}
+
+			LOG(m_log) << '[' << conf.name << "] restarting";
+			stop_pool(*pool);
+			if (pool->config.address != conf.address && pool->listener >= 0)
+			{
+				m_os->close(pool->listener);
+				pool->listener = -1;
+			}
+			pool->config = conf;
+			start_pool(*pool);
+			next[conf.name] = std::move(pool);
+		}
+
+		m_pools = std::move(next);
+	}
+
+	void supervisor::shutdown()
+	{
+		if (m_pools.empty() && m_draining.empty())
+			return;
+
+		for (auto&& pair : m_pools)
+		{
+			for (auto&& worker : pair.second->workers)
+			{
+				if (worker.pid > 0)
+					m_os->terminate(worker.pid, false);
+			}
+		}
+
+		auto deadline = m_os->now() + stop_timeout;
+		for (;;)
+		{
+			reap();
+
+			bool running = !m_draining.empty();
+			for (auto&& pair : m_pools)
+			{
+				for (auto&& worker : pair.second->workers)
+					running |= worker.pid > 0;
+			}
+
+			if (!running)
+				break;
+
+			// a rung doorbell would not let wait() sleep
+			receive();
+
+			if (m_os->now() > deadline)
+			{
+				for (auto&& pair : m_pools)
+				{
+					for (auto&& worker : pair.second->workers)
+					{
+						if (worker.pid > 0)
+							m_os->terminate(worker.pid, true);
+					}
+				}
+				for (auto&& worker : m_draining)
+					m_os->terminate(worker.pid, true);
+				deadline = m_os->now() + stop_timeout;
+			}
+
+			m_os->wait(m_output, tick);
+		}
+
+		// what the workers wrote just before they exited
+		m_output.pump(std::chrono::milliseconds{ 0 });
+
+		for (auto&& pair : m_pools)
+		{
+			if (pair.second->listener >= 0)
+				m_os->close(pair.second->listener);
+		}
+		m_pools.clear();
+	}
+
+	void supervisor::publish()
+	{
+		m_dirty = false;
+		if (state_path.empty())
+			return;
+
+		size_t workers = 0;
+		for (auto&& pair : m_pools)
+			workers += pair.second->workers.size();
+
+		if (!m_state || m_state->pool_capacity() < m_pools.size() || m_state->worker_capacity() < workers)
+		{
+			// some room to grow, so a reload does not have to replace the file; the
+			// new one is renamed over the old, so the readers always find one
+			std::unique_ptr<state_file> next{ new state_file(state_path, m_pools.size() * 2 + 1, workers * 2 + 1, m_state ? m_state->started() : 0) };
+			if (!*next)
+			{
+				LOG(m_log) << state_path << ": cannot create the state file";
+				return;
+			}
+			m_state = std::move(next);
+		}
+
+		using namespace std::chrono;
+		auto now = m_os->now();
+		auto wall = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+
+		m_state->begin();
+
+		auto pools = m_state->pools();
+		auto slots = m_state->workers();
+		uint32_t pool_id = 0;
+		size_t worker_id = 0;
+		for (auto&& pair : m_pools)
+		{
+			auto& pool = *pair.second;
+			auto& out = pools[pool_id];
+			memset(out.name, 0, sizeof(out.name));
+			strncpy(out.name, pool.config.name.c_str(), sizeof(out.name) - 1);
+			out.generation = pool.generation;
+			out.workers = (uint32_t)pool.config.workers;
+			out.process_group = pool.process_group;
+
+			for (auto&& worker : pool.workers)
+			{
+				auto& slot = slots[worker_id++];
+				slot.pid = worker.pid;
+				slot.pool = pool_id;
+				slot.generation = worker.generation;
+				slot.running = worker.pid > 0;
+				slot.started = worker.pid > 0 ? wall - duration_cast<milliseconds>(now - worker.started).count() : 0;
+			}
+			++pool_id;
+		}
+		m_state->counts(pool_id, worker_id);
+
+		m_state->commit();
+	}
+
+	int supervisor::run()
+	{
+		os::socklib lib;
+
+		supervisor_config config;
+		if (!supervisor_config::load(m_log, m_path, config))
+			return 1;
+
+		m_signals.set("stop", [this] { m_stop = true; });
+		m_signals.set("reload", [this] { m_reload = true; });
+
+		apply(config);
+
+		auto reported = m_os->now();
+		while (!m_stop)
+		{
+			reap();
+			drain();
+			receive();
+			watch();
+
+			if (m_reload.exchange(false))
+			{
+				LOG(m_log) << "Reloading " << m_path;
+				supervisor_config next;
+				if (supervisor_config::load(m_log, m_path, next))
+					apply(next);
+				else
+					LOG(m_log) << "Keeping the previous configuration";
+			}
+
+			for (auto&& pair : m_pools)
+				fill_pool(*pair.second);
+
+			if (m_dirty)
+				publish();
+
+			if (m_os->now() - reported >= std::chrono::seconds{ 10 })
+			{
+				log_suppressed(m_log);
+				reported = m_os->now();
+			}
+
+			// doubles as the sleep between the ticks
+			m_os->wait(m_output, tick);
+		}
+
+		shutdown();
+		m_state.reset();
+		return 0;
+	}
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <remote/trace.hpp>
+#include <fstream>
+
+namespace remote
+{
+	namespace
+	{
+		void escape(std::ostream& out, const std::string& str)
+		{
+			out << '"';
+			for (auto&& c : str)
+			{
+				switch (c)
+				{
+				case '"': out << "\\\""; break;
+				case '\\': out << "\\\\"; break;
+				case '\n': out << "\\n"; break;
+				case '\t': out << "\\t"; break;
+				default:
+					if ((unsigned char)c < 0x20)
+						out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+					else
+						out << c;
+				}
+			}
+			out << '"';
+		}
+
+		double micro(trace::clock::duration dur)
+		{
+			return std::chrono::duration<double, std::micro>(dur).count();
+		}
+	}
+
+	trace::trace() : m_origin(clock::now())
+	{
+	}
+
+	void trace::record(const char* name, const char* category, int lane, clock::time_point start, clock::time_point stop)
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_events.push_back({ name, category, lane, start, stop - start });
+	}
+
+	void trace::lane_name(int lane, const std::string& name)
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_lanes.emplace_back(lane, name);
+	}
+
+	void trace::write(std::ostream& out) const
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+
+		auto pid = _getpid();
+		bool first = true;
+		auto comma = [&] { if (first) first = false; else out << ",\n"; };
+
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		for (auto&& lane : m_lanes)
+		{
+			comma();
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << lane.first << ",\"args\":{\"name\":";
+			escape(out, lane.second);
+			out << "}}";
+		}
+
+		out << std::fixed << std::setprecision(3);
+		for (auto&& ev : m_events)
+		{
+			comma();
+			out << "{\"name\":";
+			escape(out, ev.name);
+			out << ",\"cat\":";
+			escape(out, ev.category);
+			out << ",\"ph\":\"X\",\"ts\":" << micro(ev.start - m_origin)
+				<< ",\"dur\":" << micro(ev.duration)
+				<< ",\"pid\":" << pid << ",\"tid\":" << ev.lane << '}';
+		}
+		out << "\n]}\n";
+	}
+
+	bool trace::save(const std::string& path) const
+	{
+		std::ofstream out{ path };
+		if (!out)
+			return false;
+
+		write(out);
+		return !!out.flush();
+	}
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Turns a binary log (see remote::binary_logger) back into text:
+ *
+ *   logdecode [-t] log.bin...
+ *
+ * One line per entry: local time, file:line and the text; -t drops the time.
+ */
+
+#include <remote/binary_log.hpp>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+	bool with_time = true;
+	int files = 0;
+	int ret = 0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-t"))
+		{
+			with_time = false;
+			continue;
+		}
+
+		++files;
+		remote::binary_log::reader log{ argv[i] };
+		if (!log)
+		{
+			std::cerr << argv[i] << ": not a binary log\n";
+			ret = 1;
+			continue;
+		}
+
+		remote::binary_log::entry entry;
+		while (log.next(entry))
+		{
+			if (with_time)
+			{
+				time_t secs = (time_t)(entry.time / 1000000000);
+				char stamp[32];
+				strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&secs));
+				char nanos[16];
+				snprintf(nanos, sizeof(nanos), ".%09lld ", (long long)(entry.time % 1000000000));
+				std::cout << stamp << nanos;
+			}
+			std::cout << entry.file << ':' << entry.line << ": " << entry.text << '\n';
+		}
+
+		if (log)
+			continue;
+
+		std::cerr << argv[i] << ": damaged record, stopping\n";
+		ret = 1;
+	}
+
+	if (!files)
+	{
+		std::cerr << "usage: " << argv[0] << " [-t] log.bin...\n";
+		return 2;
+	}
+
+	return ret;
+}
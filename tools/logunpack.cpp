@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Prints a compressed log (see remote::compressed_logger) as text:
+ *
+ *   logunpack [-l] [-f frame | -s time] log.lz...
+ *
+ * -l lists the frames instead (number, file offset, raw offset, time,
+ * sizes), which is all the index there is. -f starts at the given frame,
+ * -s at the last frame started before the given unix time in seconds;
+ * neither decompresses what comes before.
+ */
+
+#include <remote/compressed_log.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+	bool list = false;
+	uint64_t first = 0;
+	int64_t since = 0;
+	int files = 0;
+	int ret = 0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-l"))
+		{
+			list = true;
+			continue;
+		}
+
+		if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "-s")) && i + 1 < argc)
+		{
+			if (argv[i][1] == 'f')
+				first = strtoull(argv[++i], nullptr, 10);
+			else
+				since = strtoll(argv[++i], nullptr, 10) * 1000000000;
+			continue;
+		}
+
+		++files;
+		remote::compressed_log::reader log{ argv[i] };
+		if (!log)
+		{
+			std::cerr << argv[i] << ": not a compressed log\n";
+			ret = 1;
+			continue;
+		}
+
+		// the index: every frame header, in order
+		std::vector<remote::compressed_log::frame> frames;
+		remote::compressed_log::frame frame;
+		while (log.next(frame))
+			frames.push_back(frame);
+
+		if (list)
+		{
+			for (size_t n = 0; n < frames.size(); ++n)
+			{
+				auto& f = frames[n];
+				time_t secs = (time_t)(f.time / 1000000000);
+				char stamp[32];
+				strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&secs));
+				std::cout << n << ' ' << f.offset << ' ' << f.raw_offset << ' ' << stamp << ' '
+					<< f.raw_size << " -> " << f.stored_size << (f.flags ? "" : " (stored)") << '\n';
+			}
+			continue;
+		}
+
+		size_t start = (size_t)std::min<uint64_t>(first, frames.size());
+		if (since)
+		{
+			while (start + 1 < frames.size() && frames[start + 1].time <= since)
+				++start;
+		}
+
+		std::string text;
+		for (size_t n = start; n < frames.size(); ++n)
+		{
+			if (!log.read(frames[n], text))
+			{
+				std::cerr << argv[i] << ": frame " << n << " is damaged, skipping it\n";
+				ret = 1;
+				continue;
+			}
+			std::cout.write(text.data(), (std::streamsize)text.size());
+		}
+	}
+
+	if (!files)
+	{
+		std::cerr << "usage: " << argv[0] << " [-l] [-f frame | -s time] log.lz...\n";
+		return 2;
+	}
+
+	return ret;
+}